@@ -0,0 +1,127 @@
+#include "DistanceGenerator.h"
+
+#include <algorithm>  // std::max
+#include <cmath>  // std::ceil, std::log, std::sqrt
+#include <cstdint>  // int64_t, uint64_t
+#include <random>  // std::mt19937_64, std::uniform_real_distribution
+#include <utility>  // std::swap
+#include <vector>  // std::vector
+
+DistanceGenerator::DistanceGenerator(uint64_t seed) : rng(seed) {}
+
+std::vector<double> DistanceGenerator::euclidean(int64_t n, int dims) {
+	// Points uniformly distributed in the unit hypercube
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	std::vector<double> points(n * dims);
+	for (int64_t p = 0; p < n * dims; p ++) {
+		points[p] = uniform(this->rng);
+	}
+	std::vector<double> values(n * (n - 1) / 2);
+	for (int64_t j = 0; j < n; j ++) {
+		for (int64_t i = j + 1; i < n; i ++) {
+			double d2 = 0.0;
+			for (int c = 0; c < dims; c ++) {
+				double delta = points[i * dims + c] - points[j * dims + c];
+				d2 += delta * delta;
+			}
+			values[index(n, i, j)] = std::sqrt(d2);
+		}
+	}
+	return values;
+}
+
+std::vector<double> DistanceGenerator::ultrametric(int64_t n) {
+	std::vector<double> values;
+	randomTree(n, true, values);
+	return values;
+}
+
+std::vector<double> DistanceGenerator::additive(int64_t n) {
+	std::vector<double> values;
+	randomTree(n, false, values);
+	return values;
+}
+
+std::vector<double> DistanceGenerator::discrete(int64_t n, int levels) {
+	// Additive distances rounded up to a few levels, so that most of them are
+	// tied and the tree has large polytomies
+	std::vector<double> values;
+	randomTree(n, false, values);
+	double maxValue = 0.0;
+	for (std::size_t v = 0; v < values.size(); v ++) {
+		maxValue = std::max(maxValue, values[v]);
+	}
+	for (std::size_t v = 0; v < values.size(); v ++) {
+		values[v] = std::ceil(values[v] / maxValue * (double)levels);
+	}
+	return values;
+}
+
+void DistanceGenerator::randomTree(int64_t n, bool clock,
+		std::vector<double>& values) {
+	// Random joining of clusters, where the distances between the taxa of the
+	// two clusters joined go through the new node, so every pair is set once.
+	// With a molecular clock, joins follow the waiting times of a coalescent
+	// and the distances are ultrametric
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	values.assign(n * (n - 1) / 2, 0.0);
+	std::vector< std::vector<int64_t> > members(n);
+	std::vector<double> depth(n, 0.0);  // Distance of every taxon to its root
+	std::vector<double> height(n, 0.0);  // Height of the root of every cluster
+	std::vector<int64_t> roots(n);  // Clusters not joined yet
+	for (int64_t i = 0; i < n; i ++) {
+		members[i].push_back(i);
+		roots[i] = i;
+	}
+	double time = 0.0;
+	for (int64_t k = n; k > 1; k --) {
+		int64_t a = (int64_t)(this->rng() % (uint64_t)k);
+		int64_t b = (int64_t)(this->rng() % (uint64_t)(k - 1));
+		if (b >= a) {
+			b ++;
+		}
+		int64_t ca = roots[a];
+		int64_t cb = roots[b];
+		double la;
+		double lb;
+		if (clock) {
+			time -= std::log(1.0 - uniform(this->rng))
+					/ (double)(k * (k - 1) / 2);
+			la = time - height[ca];
+			lb = time - height[cb];
+		} else {
+			la = 0.01 + uniform(this->rng);
+			lb = 0.01 + uniform(this->rng);
+		}
+		for (std::size_t x = 0; x < members[ca].size(); x ++) {
+			int64_t i = members[ca][x];
+			for (std::size_t y = 0; y < members[cb].size(); y ++) {
+				int64_t j = members[cb][y];
+				double dij = depth[i] + la + depth[j] + lb;
+				values[(i > j)? index(n, i, j) : index(n, j, i)] = dij;
+			}
+		}
+		for (std::size_t x = 0; x < members[ca].size(); x ++) {
+			depth[members[ca][x]] += la;
+		}
+		for (std::size_t y = 0; y < members[cb].size(); y ++) {
+			depth[members[cb][y]] += lb;
+		}
+		// Taxa of the smaller cluster are moved to the larger one
+		if (members[ca].size() < members[cb].size()) {
+			std::swap(ca, cb);
+		}
+		members[ca].insert(members[ca].end(), members[cb].begin(),
+				members[cb].end());
+		std::vector<int64_t>().swap(members[cb]);
+		height[ca] = time;
+		roots[a] = ca;
+		roots[b] = roots[k - 1];
+	}
+	return;
+}
+
+int64_t DistanceGenerator::index(int64_t n, int64_t i, int64_t j) {
+	// Value (i, j), with i > j, in the order of "dist" structures
+	return j * n - (j + 1) * (j + 2) / 2 + i;
+}
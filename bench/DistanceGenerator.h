@@ -0,0 +1,23 @@
+#ifndef DISTANCEGENERATOR_H_
+#define DISTANCEGENERATOR_H_
+
+#include <cstdint>  // int64_t, uint64_t
+#include <random>  // std::mt19937_64
+#include <vector>  // std::vector
+
+// Generator of synthetic distances between n taxa, by columns of the lower
+// triangle as Matrix stores them
+class DistanceGenerator {
+public:
+    DistanceGenerator(uint64_t seed);
+    std::vector<double> euclidean(int64_t n, int dims);
+    std::vector<double> ultrametric(int64_t n);
+    std::vector<double> additive(int64_t n);
+    std::vector<double> discrete(int64_t n, int levels);
+private:
+    std::mt19937_64 rng;  // Source of random numbers
+    void randomTree(int64_t n, bool clock, std::vector<double>& values);
+    static int64_t index(int64_t n, int64_t i, int64_t j);
+};
+
+#endif /* DISTANCEGENERATOR_H_ */
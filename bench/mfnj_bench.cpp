@@ -0,0 +1,351 @@
+#include <algorithm>  // std::max, std::min
+#include <chrono>  // std::chrono::duration, std::chrono::steady_clock
+#include <cstdint>  // int64_t, uint64_t
+#include <cstdlib>  // std::strtol, EXIT_FAILURE, EXIT_SUCCESS
+#include <exception>  // std::exception
+#include <iostream>  // std::cerr, std::cout
+#include <sstream>  // std::istringstream
+#include <stdexcept>  // std::runtime_error
+#include <string>  // std::string, std::to_string
+#include <utility>  // std::move
+#include <vector>  // std::vector
+
+#ifndef _WIN32
+#include <sys/resource.h>  // getrusage
+#endif
+
+#include "DistanceGenerator.h"
+#include "Matrix.h"
+#include "Phylogeny.h"
+#include "Profile.h"
+
+// Options of the command line
+class Options {
+public:
+	Options();
+	std::vector<int64_t> sizes;  // Numbers of taxa
+	std::vector<std::string> generators;  // Kinds of distances
+	std::string filter;  // Text that the names of the benchmarks must contain
+	int repetitions;  // Repetitions of every benchmark
+	int threads;  // Number of threads
+	bool incremental;  // Update sums of distances incrementally
+	bool bounded;  // Bounded search of the minimum sum of branch lengths
+	uint64_t seed;  // Seed of the generated distances
+};
+
+Options::Options() {
+	this->sizes = {100, 1000};
+	this->generators = {"euclidean", "ultrametric", "additive", "discrete"};
+	this->repetitions = 3;
+	this->threads = 1;
+	this->incremental = false;
+	this->bounded = false;
+	this->seed = 1;
+}
+
+// Result of a benchmark, with the profile of the reconstruction, if any
+class Result {
+public:
+	Result();
+	double seconds;  // Minimum time of all repetitions
+	bool profiled;  // Phases and bytes were recorded
+	RoundProfile total;  // Seconds of every phase, and maximum bytes
+	int polytomies;  // Number of polytomies of the tree
+};
+
+Result::Result() {
+	this->seconds = 0.0;
+	this->profiled = false;
+	this->polytomies = 0;
+}
+
+static void printUsage(std::ostream& out) {
+	out << "Usage: mfnj_bench [options]\n"
+		<< "Times the reconstruction, the detection of the precision and the"
+		<< " Newick\nstring of generated distances, and writes a row of"
+		<< " tab-separated values\nper benchmark, with the peak resident"
+		<< " memory of the process and the\nseconds and bytes of every phase"
+		<< " of the reconstruction.\n\n"
+		<< "Options:\n"
+		<< "  -n, --sizes N,...       numbers of taxa (default: 100,1000)\n"
+		<< "  -g, --generators G,...  kinds of distances: euclidean,"
+		<< " ultrametric,\n                          additive or discrete"
+		<< " (default: all)\n"
+		<< "  -f, --filter TEXT       run only the benchmarks whose name"
+		<< " contains TEXT\n"
+		<< "  -r, --repetitions N     repetitions of every benchmark"
+		<< " (default: 3)\n"
+		<< "  -t, --threads N         number of threads (default: 1)\n"
+		<< "  -i, --incremental       update sums of distances"
+		<< " incrementally\n"
+		<< "  -b, --bounded           bounded search of the minimum sum of"
+		<< " branch lengths\n"
+		<< "  -s, --seed N            seed of the generated distances"
+		<< " (default: 1)\n"
+		<< "  -h, --help              print this help and exit\n";
+	return;
+}
+
+static int64_t parseInteger(const std::string& option,
+		const std::string& value) {
+	char* end;
+	long number = std::strtol(value.c_str(), &end, 10);
+	if (value.empty() || (*end != '\0') || (number < 1)) {
+		throw std::runtime_error("option " + option
+				+ " requires a positive integer");
+	}
+	return (int64_t)number;
+}
+
+static std::vector<std::string> splitList(const std::string& value) {
+	std::vector<std::string> items;
+	std::istringstream in(value);
+	std::string item;
+	while (std::getline(in, item, ',')) {
+		items.push_back(item);
+	}
+	return items;
+}
+
+static Options parseOptions(int argc, char** argv) {
+	Options options;
+	for (int a = 1; a < argc; a ++) {
+		std::string arg = argv[a];
+		if ((arg == "-i") || (arg == "--incremental")) {
+			options.incremental = true;
+		} else if ((arg == "-b") || (arg == "--bounded")) {
+			options.bounded = true;
+		} else if ((arg == "-h") || (arg == "--help")) {
+			printUsage(std::cout);
+			std::exit(EXIT_SUCCESS);
+		} else {
+			if (a + 1 == argc) {
+				throw std::runtime_error("unknown option " + arg);
+			}
+			std::string value = argv[a + 1];
+			a ++;
+			if ((arg == "-n") || (arg == "--sizes")) {
+				std::vector<std::string> items = splitList(value);
+				options.sizes.clear();
+				for (std::size_t s = 0; s < items.size(); s ++) {
+					int64_t n = parseInteger(arg, items[s]);
+					if (n < 3) {
+						throw std::runtime_error("the number of taxa must be"
+								" at least 3");
+					}
+					options.sizes.push_back(n);
+				}
+			} else if ((arg == "-g") || (arg == "--generators")) {
+				options.generators = splitList(value);
+				for (std::size_t g = 0; g < options.generators.size(); g ++) {
+					const std::string& generator = options.generators[g];
+					if ((generator != "euclidean")
+							&& (generator != "ultrametric")
+							&& (generator != "additive")
+							&& (generator != "discrete")) {
+						throw std::runtime_error("unknown generator "
+								+ generator);
+					}
+				}
+			} else if ((arg == "-f") || (arg == "--filter")) {
+				options.filter = value;
+			} else if ((arg == "-r") || (arg == "--repetitions")) {
+				options.repetitions = (int)parseInteger(arg, value);
+			} else if ((arg == "-t") || (arg == "--threads")) {
+				options.threads = (int)parseInteger(arg, value);
+			} else if ((arg == "-s") || (arg == "--seed")) {
+				options.seed = (uint64_t)parseInteger(arg, value);
+			} else {
+				throw std::runtime_error("unknown option " + arg);
+			}
+		}
+	}
+	return options;
+}
+
+static double peakMegabytes() {
+	// Peak resident memory of the process, which never decreases
+	double megabytes = -1.0;
+#ifndef _WIN32
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+		megabytes = (double)usage.ru_maxrss / (1024.0 * 1024.0);  // bytes
+#else
+		megabytes = (double)usage.ru_maxrss / 1024.0;  // kilobytes
+#endif
+	}
+#endif
+	return megabytes;
+}
+
+static double elapsed(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now()
+			- start).count();
+}
+
+static void printHeader() {
+	std::cout << "benchmark\tn\trepetitions\tseconds\tpeak_mb\tsums\tminimize"
+			<< "\tconnect\tagglomerate\tupdate\tbytes\tpolytomies\n";
+	return;
+}
+
+static void printResult(const std::string& name, int64_t n,
+		const Options& options, const Result& result) {
+	std::cout << name << "\t" << n << "\t" << options.repetitions << "\t"
+			<< result.seconds << "\t" << peakMegabytes();
+	if (result.profiled) {
+		const RoundProfile& total = result.total;
+		std::cout << "\t" << total.sums << "\t" << total.minimize << "\t"
+				<< total.connect << "\t" << total.agglomerate << "\t"
+				<< total.update << "\t" << total.bytes << "\t"
+				<< result.polytomies << "\n";
+	} else {
+		std::cout << "\tNA\tNA\tNA\tNA\tNA\tNA\tNA\n";
+	}
+	std::cout.flush();
+	return;
+}
+
+static void prepareTree(const std::vector<double>& values,
+		const Options& options, Phylogeny& phylo) {
+	// Distances are copied and their precision detected outside the timing
+	Matrix dist(values);
+	int digits = dist.precision(options.threads);
+	phylo.setDistances(std::move(dist), digits);
+	phylo.setIncrementalSums(options.incremental);
+	phylo.setThreads(options.threads);
+	phylo.setBoundedSearch(options.bounded);
+	phylo.setProfiling(true);
+	return;
+}
+
+static Result benchReconstruct(const std::vector<double>& values,
+		const Options& options) {
+	// Phases of the fastest repetition, whose bytes are the maximum of its
+	// rounds
+	Result result;
+	result.profiled = true;
+	for (int r = 0; r < options.repetitions; r ++) {
+		Phylogeny phylo;
+		prepareTree(values, options, phylo);
+		std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+		phylo.reconstruct();
+		double seconds = elapsed(start);
+		if ((r == 0) || (seconds < result.seconds)) {
+			const std::vector<RoundProfile>& rounds = phylo.getProfile();
+			result.seconds = seconds;
+			result.total = RoundProfile();
+			for (std::size_t k = 0; k < rounds.size(); k ++) {
+				result.total.sums += rounds[k].sums;
+				result.total.minimize += rounds[k].minimize;
+				result.total.connect += rounds[k].connect;
+				result.total.agglomerate += rounds[k].agglomerate;
+				result.total.update += rounds[k].update;
+				result.total.bytes = std::max(result.total.bytes,
+						rounds[k].bytes);
+			}
+			result.polytomies = phylo.numPolytomies();
+		}
+	}
+	return result;
+}
+
+static Result benchPrecision(const std::vector<double>& values,
+		const Options& options) {
+	Result result;
+	Matrix dist(values);
+	for (int r = 0; r < options.repetitions; r ++) {
+		std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+		volatile int digits = dist.precision(options.threads);
+		(void)digits;
+		double seconds = elapsed(start);
+		result.seconds = (r == 0)? seconds : std::min(result.seconds, seconds);
+	}
+	return result;
+}
+
+static Result benchNewick(const std::vector<double>& values,
+		const Options& options, int64_t n) {
+	Result result;
+	std::vector<std::string> labels(n);
+	for (int64_t i = 0; i < n; i ++) {
+		labels[i] = "t" + std::to_string(i + 1);
+	}
+	Phylogeny phylo;
+	prepareTree(values, options, phylo);
+	phylo.setProfiling(false);
+	phylo.reconstruct();
+	for (int r = 0; r < options.repetitions; r ++) {
+		std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+		std::string newick = phylo.getNewick(labels);
+		double seconds = elapsed(start);
+		result.seconds = (r == 0)? seconds : std::min(result.seconds, seconds);
+	}
+	return result;
+}
+
+static std::vector<double> generate(const std::string& generator, int64_t n,
+		uint64_t seed) {
+	DistanceGenerator distances(seed);
+	std::vector<double> values;
+	if (generator == "euclidean") {
+		values = distances.euclidean(n, 10);
+	} else if (generator == "ultrametric") {
+		values = distances.ultrametric(n);
+	} else if (generator == "additive") {
+		values = distances.additive(n);
+	} else {
+		values = distances.discrete(n, 10);
+	}
+	return values;
+}
+
+static bool selected(const std::string& name, const Options& options) {
+	return name.find(options.filter) != std::string::npos;
+}
+
+int main(int argc, char** argv) {
+	int status = EXIT_SUCCESS;
+	try {
+		Options options = parseOptions(argc, argv);
+		printHeader();
+		for (std::size_t g = 0; g < options.generators.size(); g ++) {
+			const std::string& generator = options.generators[g];
+			for (std::size_t s = 0; s < options.sizes.size(); s ++) {
+				int64_t n = options.sizes[s];
+				std::string suffix = "/" + generator + "/" + std::to_string(n);
+				std::string precision = "precision" + suffix;
+				std::string reconstruct = "reconstruct" + suffix;
+				std::string newick = "newick" + suffix;
+				bool any = selected(precision, options)
+						|| selected(reconstruct, options)
+						|| selected(newick, options);
+				// Distances are only generated for selected benchmarks
+				std::vector<double> values;
+				if (any) {
+					values = generate(generator, n, options.seed);
+				}
+				if (selected(precision, options)) {
+					printResult(precision, n, options,
+							benchPrecision(values, options));
+				}
+				if (selected(reconstruct, options)) {
+					printResult(reconstruct, n, options,
+							benchReconstruct(values, options));
+				}
+				if (selected(newick, options)) {
+					printResult(newick, n, options,
+							benchNewick(values, options, n));
+				}
+			}
+		}
+	} catch (const std::exception& e) {
+		std::cerr << "mfnj_bench: " << e.what() << "\n";
+		status = EXIT_FAILURE;
+	}
+	return status;
+}
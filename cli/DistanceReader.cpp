@@ -0,0 +1,111 @@
+#include "DistanceReader.h"
+
+#include <cctype>  // std::isspace
+#include <cmath>  // std::isfinite
+#include <cstdint>  // int64_t
+#include <cstdlib>  // std::strtod, std::strtoll
+#include <istream>  // std::istream
+#include <iterator>  // std::istreambuf_iterator
+#include <stdexcept>  // std::runtime_error
+#include <string>  // std::string
+#include <utility>  // std::move
+#include <vector>  // std::vector
+
+#include "Matrix.h"
+
+DistanceReader::DistanceReader() {}
+
+void DistanceReader::read(std::istream& in) {
+	std::string text((std::istreambuf_iterator<char>(in)),
+			std::istreambuf_iterator<char>());
+	const char* p = text.data();
+	const char* end = text.data() + text.size();
+	const char* tokenEnd;
+	// Number of taxa
+	p = nextToken(p, end, tokenEnd);
+	if (p == end) {
+		throw std::runtime_error("empty distance file");
+	}
+	char* numberEnd;
+	int64_t n = std::strtoll(p, &numberEnd, 10);
+	if ((numberEnd != tokenEnd) || (n < 3)) {
+		throw std::runtime_error("the number of taxa must be at least 3");
+	}
+	// Square matrices have n values per taxon, and lower triangular ones have
+	// as many values as preceding taxa
+	int64_t nTokens = countTokens(text) - 1;
+	bool square;
+	if (nTokens == n * (n + 1)) {
+		square = true;
+	} else if (nTokens == n * (n + 1) / 2) {
+		square = false;
+	} else {
+		throw std::runtime_error("expected a square or lower triangular "
+				"matrix of " + std::to_string(n) + " taxa");
+	}
+	this->labels.clear();
+	this->labels.reserve(n);
+	this->dist = Matrix(n);
+	p = tokenEnd;
+	for (int64_t i = 0; i < n; i ++) {
+		p = nextToken(p, end, tokenEnd);
+		this->labels.push_back(std::string(p, tokenEnd));
+		p = tokenEnd;
+		int64_t nValues = square? n : i;
+		for (int64_t j = 0; j < nValues; j ++) {
+			p = nextToken(p, end, tokenEnd);
+			double dij = parseDistance(p, tokenEnd, i);
+			if (j < i) {  // upper triangle of square matrices is ignored
+				this->dist.setValue(i, j, dij);
+			}
+			p = tokenEnd;
+		}
+	}
+	return;
+}
+
+const std::vector<std::string>& DistanceReader::getLabels() const {
+	return this->labels;
+}
+
+Matrix& DistanceReader::getDistances() {
+	return this->dist;
+}
+
+int64_t DistanceReader::countTokens(const std::string& text) {
+	int64_t nTokens = 0;
+	bool blank = true;
+	for (std::size_t k = 0; k < text.size(); k ++) {
+		bool space = std::isspace((unsigned char)text[k]) != 0;
+		if (blank && !space) {
+			nTokens ++;
+		}
+		blank = space;
+	}
+	return nTokens;
+}
+
+const char* DistanceReader::nextToken(const char* p, const char* end,
+		const char*& tokenEnd) {
+	// Skip blanks and return the start of the next token
+	while ((p < end) && std::isspace((unsigned char)*p)) {
+		p ++;
+	}
+	tokenEnd = p;
+	while ((tokenEnd < end) && !std::isspace((unsigned char)*tokenEnd)) {
+		tokenEnd ++;
+	}
+	return p;
+}
+
+double DistanceReader::parseDistance(const char* token, const char* tokenEnd,
+		int64_t i) const {
+	char* numberEnd;
+	double value = std::strtod(token, &numberEnd);
+	if ((numberEnd != tokenEnd) || !std::isfinite(value) || (value < 0.0)) {
+		throw std::runtime_error("invalid distance '"
+				+ std::string(token, tokenEnd) + "' of taxon '"
+				+ this->labels[i] + "'");
+	}
+	return value;
+}
@@ -0,0 +1,29 @@
+#ifndef DISTANCEREADER_H_
+#define DISTANCEREADER_H_
+
+#include <cstdint>  // int64_t
+#include <istream>  // std::istream
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+#include "Matrix.h"
+
+// Reader of distances in PHYLIP format, either square or lower triangular,
+// whose taxon names are separated from the distances by blanks
+class DistanceReader {
+public:
+    DistanceReader();
+    void read(std::istream& in);
+    const std::vector<std::string>& getLabels() const;
+    Matrix& getDistances();
+private:
+    std::vector<std::string> labels;  // Names of the taxa
+    Matrix dist;  // Distances between taxa
+    static int64_t countTokens(const std::string& text);
+    static const char* nextToken(const char* p, const char* end,
+    		const char*& tokenEnd);
+    double parseDistance(const char* token, const char* tokenEnd,
+    		int64_t i) const;
+};
+
+#endif /* DISTANCEREADER_H_ */
@@ -0,0 +1,498 @@
+#include <csignal>  // std::signal, std::sig_atomic_t, SIGINT, SIGTERM
+#include <cstdint>  // int64_t
+#include <cstdio>  // std::remove
+#include <cstdlib>  // std::strtol, EXIT_FAILURE, EXIT_SUCCESS
+#include <exception>  // std::exception
+#include <fstream>  // std::ifstream, std::ofstream
+#include <iostream>  // std::cerr, std::cin, std::cout
+#include <memory>  // std::unique_ptr
+#include <stdexcept>  // std::runtime_error
+#include <string>  // std::string
+#include <utility>  // std::move
+#include <vector>  // std::vector
+
+#include "Alignment.h"
+#include "DistanceFile.h"
+#include "DistanceReader.h"
+#include "Matrix.h"
+#include "Phylogeny.h"
+#include "Profile.h"
+#include "TemporaryFile.h"
+
+// Options of the command line
+class Options {
+public:
+	Options();
+	int digits;  // Precision, or negative to detect it
+	bool incremental;  // Update sums of distances incrementally
+	int threads;  // Number of threads
+	bool bounded;  // Bounded search of the minimum sum of branch lengths
+	bool verbose;  // Print precision and polytomies of every tree
+	bool inPlace;  // Update binary distance files in place
+	std::string storage;  // Storage of the distances: double, fixed or float
+	std::string model;  // Model of the distances of alignments, if any
+	std::string output;  // Output file, or empty for standard output
+	std::string profile;  // Profile file of the rounds, if any
+	std::string binary;  // Binary distance file to write, if any
+	std::string checkpoint;  // State file of the reconstruction, if any
+	int every;  // Rounds between states written
+	std::string resume;  // State file to resume the reconstruction from
+	std::vector<std::string> inputs;  // Input files, or "-" for standard input
+};
+
+Options::Options() {
+	this->digits = -1;
+	this->incremental = false;
+	this->threads = 1;
+	this->bounded = false;
+	this->verbose = false;
+	this->inPlace = false;
+	this->storage = "double";
+	this->every = 1000;
+}
+
+static void printUsage(std::ostream& out) {
+	out << "Usage: mfnj [options] [file ...]\n"
+		<< "Reconstructs a multifurcated phylogenetic tree from every distance"
+		<< " file,\nin PHYLIP square or lower triangular format, and writes"
+		<< " one Newick tree\nper line. Standard input is read if no file or"
+		<< " \"-\" is given. Binary distance\nfiles, as written by option -w"
+		<< " or by mfnj_write() in R, are mapped into\nmemory instead of being"
+		<< " read. With option -a, files are DNA alignments in\nFASTA format,"
+		<< " whose distances are computed first.\n\n"
+		<< "Options:\n"
+		<< "  -d, --digits N      number of significant decimal digits"
+		<< " (default: detected)\n"
+		<< "  -i, --incremental   update sums of distances incrementally\n"
+		<< "  -t, --threads N     number of threads (default: 1)\n"
+		<< "  -b, --bounded       bounded search of the minimum sum of branch"
+		<< " lengths\n"
+		<< "  -s, --storage TYPE  storage of the distances: double (default),"
+		<< " or fixed\n                      or float, which are approximate\n"
+		<< "  -a, --alignment MODEL\n"
+		<< "                      read alignments, with the distances of MODEL:"
+		<< " raw,\n                      JC69 or K80\n"
+		<< "  -o, --output FILE   write the trees to FILE instead of standard"
+		<< " output\n"
+		<< "  -p, --profile FILE  write the work and the seconds of every round"
+		<< " to FILE,\n                      as tab-separated values\n"
+		<< "  -m, --in-place      update binary distance files in place, which"
+		<< " are\n                      rejected afterwards\n"
+		<< "  -w, --write FILE    write the distances of a text file to binary"
+		<< " FILE\n                      instead of reconstructing the tree\n"
+		<< "  -c, --checkpoint FILE\n"
+		<< "                      write the state of the reconstruction to FILE"
+		<< " every N\n                      rounds, and when the process is"
+		<< " terminated or receives\n                      SIGUSR1\n"
+		<< "  -k, --every N       rounds between states written (default:"
+		<< " 1000)\n"
+		<< "  -r, --resume FILE   resume the reconstruction from the state in"
+		<< " FILE\n"
+		<< "  -v, --verbose       print precision, polytomies and approximate"
+		<< " storage of\n                      every tree to standard error\n"
+		<< "  -h, --help          print this help and exit\n";
+	return;
+}
+
+static int parseInteger(const std::string& option, const std::string& value) {
+	char* end;
+	long number = std::strtol(value.c_str(), &end, 10);
+	if (value.empty() || (*end != '\0')) {
+		throw std::runtime_error("option " + option + " requires an integer");
+	}
+	return (int)number;
+}
+
+static Options parseOptions(int argc, char** argv) {
+	Options options;
+	for (int a = 1; a < argc; a ++) {
+		std::string arg = argv[a];
+		if ((arg == "-d") || (arg == "--digits") || (arg == "-t")
+				|| (arg == "--threads") || (arg == "-o")
+				|| (arg == "--output") || (arg == "-p") || (arg == "--profile")
+				|| (arg == "-s") || (arg == "--storage")
+				|| (arg == "-w") || (arg == "--write") || (arg == "-c")
+				|| (arg == "--checkpoint") || (arg == "-k")
+				|| (arg == "--every") || (arg == "-r")
+				|| (arg == "--resume") || (arg == "-a")
+				|| (arg == "--alignment")) {
+			if (a + 1 == argc) {
+				throw std::runtime_error("option " + arg + " requires a value");
+			}
+			std::string value = argv[a + 1];
+			a ++;
+			if ((arg == "-d") || (arg == "--digits")) {
+				options.digits = parseInteger(arg, value);
+			} else if ((arg == "-t") || (arg == "--threads")) {
+				options.threads = parseInteger(arg, value);
+				if (options.threads < 1) {
+					throw std::runtime_error("option " + arg
+							+ " must be a positive integer");
+				}
+			} else if ((arg == "-o") || (arg == "--output")) {
+				options.output = value;
+			} else if ((arg == "-p") || (arg == "--profile")) {
+				options.profile = value;
+			} else if ((arg == "-c") || (arg == "--checkpoint")) {
+				options.checkpoint = value;
+			} else if ((arg == "-k") || (arg == "--every")) {
+				options.every = parseInteger(arg, value);
+				if (options.every < 1) {
+					throw std::runtime_error("option " + arg
+							+ " must be a positive integer");
+				}
+			} else if ((arg == "-r") || (arg == "--resume")) {
+				options.resume = value;
+			} else if ((arg == "-a") || (arg == "--alignment")) {
+				Alignment::parseModel(value);
+				options.model = value;
+			} else if ((arg == "-s") || (arg == "--storage")) {
+				if ((value != "double") && (value != "fixed")
+						&& (value != "float")) {
+					throw std::runtime_error("option " + arg
+							+ " must be double, fixed or float");
+				}
+				options.storage = value;
+			} else {
+				options.binary = value;
+			}
+		} else if ((arg == "-i") || (arg == "--incremental")) {
+			options.incremental = true;
+		} else if ((arg == "-b") || (arg == "--bounded")) {
+			options.bounded = true;
+		} else if ((arg == "-m") || (arg == "--in-place")) {
+			options.inPlace = true;
+		} else if ((arg == "-v") || (arg == "--verbose")) {
+			options.verbose = true;
+		} else if ((arg == "-h") || (arg == "--help")) {
+			printUsage(std::cout);
+			std::exit(EXIT_SUCCESS);
+		} else if ((arg.size() > 1) && (arg[0] == '-')) {
+			throw std::runtime_error("unknown option " + arg);
+		} else {
+			options.inputs.push_back(arg);
+		}
+	}
+	if (!options.resume.empty()) {
+		if (!options.inputs.empty() || !options.binary.empty()) {
+			throw std::runtime_error("option -r does not take input files");
+		}
+		return options;
+	}
+	if (options.inputs.empty()) {
+		options.inputs.push_back("-");
+	}
+	if (!options.checkpoint.empty() && (options.inputs.size() > 1)) {
+		throw std::runtime_error("option -c requires a single input");
+	}
+	if (!options.binary.empty() && (options.inputs.size() > 1)) {
+		throw std::runtime_error("option -w requires a single input");
+	}
+	return options;
+}
+
+static void readText(const std::string& input, DistanceReader& reader) {
+	if (input == "-") {
+		reader.read(std::cin);
+	} else {
+		std::ifstream in(input.c_str(), std::ios::binary);
+		if (!in) {
+			throw std::runtime_error("cannot open " + input);
+		}
+		reader.read(in);
+	}
+	return;
+}
+
+static void readAlignment(const std::string& input, const Options& options,
+		Matrix& dist, std::vector<std::string>& labels) {
+	// Sites missing in any sequence are removed, as in dist.dna() of ape
+	Alignment alignment;
+	if (input == "-") {
+		alignment.read(std::cin);
+	} else {
+		std::ifstream in(input.c_str(), std::ios::binary);
+		if (!in) {
+			throw std::runtime_error("cannot open " + input);
+		}
+		alignment.read(in);
+	}
+	dist = alignment.distances(Alignment::parseModel(options.model), false,
+			options.threads);
+	labels = alignment.getLabels();
+	return;
+}
+
+static void writeProfile(const std::vector<RoundProfile>& rounds,
+		const std::string& input, std::ostream& profile) {
+	for (std::size_t r = 0; r < rounds.size(); r ++) {
+		const RoundProfile& round = rounds[r];
+		profile << input << "\t" << round.round << "\t" << round.nOTUs
+				<< "\t" << round.nTies << "\t" << round.nMergers << "\t"
+				<< round.maxMerged << "\t" << round.bytes << "\t"
+				<< round.sums << "\t" << round.minimize << "\t"
+				<< round.connect << "\t" << round.agglomerate << "\t"
+				<< round.update << "\n";
+	}
+	return;
+}
+
+// Signal received by the process, if any
+static volatile std::sig_atomic_t signalReceived = 0;
+
+static void handleSignal(int signal) {
+	signalReceived = signal;
+	return;
+}
+
+// Writer of the state of a reconstruction every some rounds, and when the
+// process receives a signal, which stops it unless it is SIGUSR1
+template <typename T>
+class Checkpointer : public Progress {
+public:
+	Checkpointer(BasicPhylogeny<T>& phylo,
+			const std::vector<std::string>& labels, const Options& options);
+	bool update(int64_t round, int64_t nOTUs);
+private:
+	BasicPhylogeny<T>& phylo;  // Reconstruction in progress
+	const std::vector<std::string>& labels;  // Labels of the taxa
+	const Options& options;  // Options of the command line
+	void write();
+};
+
+template <typename T>
+Checkpointer<T>::Checkpointer(BasicPhylogeny<T>& phylo,
+		const std::vector<std::string>& labels, const Options& options)
+		: phylo(phylo), labels(labels), options(options) {
+}
+
+template <typename T>
+bool Checkpointer<T>::update(int64_t round, int64_t nOTUs) {
+	int signal = signalReceived;
+	signalReceived = 0;
+	bool stop = (signal != 0);
+#ifdef SIGUSR1
+	stop = stop && (signal != SIGUSR1);
+#endif
+	if ((nOTUs > 1) && ((round % this->options.every == 0) || (signal != 0))) {
+		write();
+	}
+	return !stop;
+}
+
+template <typename T>
+void Checkpointer<T>::write() {
+	// The previous state is only replaced by a temporary file of its own
+	// once the new one is complete, and concurrent writers of the same path
+	// never share their temporary files
+	std::string path = this->options.checkpoint;
+	std::string temporary = temporaryPath(path);
+	std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+	if (!out) {
+		throw std::runtime_error("cannot create " + temporary);
+	}
+	try {
+		this->phylo.writeState(out, this->labels);
+	} catch (const std::runtime_error&) {
+		out.close();
+		std::remove(temporary.c_str());
+		throw;
+	}
+	out.close();
+	if (!out) {
+		std::remove(temporary.c_str());
+		throw std::runtime_error("cannot write " + temporary);
+	}
+	replaceFile(temporary, path);
+	return;
+}
+
+template <typename T>
+static void finishTree(BasicPhylogeny<T>& phylo,
+		const std::vector<std::string>& labels, const std::string& input,
+		const Options& options, std::ostream& out, std::ostream* profile) {
+	phylo.setThreads(options.threads);
+	phylo.setProfiling(profile != nullptr);
+	Checkpointer<T> checkpointer(phylo, labels, options);
+	if (!options.checkpoint.empty()) {
+		phylo.setProgress(&checkpointer);
+	}
+	phylo.reconstruct();
+	phylo.setProgress(nullptr);
+	if (!phylo.isFinished()) {
+		throw std::runtime_error("stopped by a signal, state written to "
+				+ options.checkpoint);
+	}
+	out << phylo.getNewick(labels) << "\n";
+	if (profile != nullptr) {
+		writeProfile(phylo.getProfile(), input, *profile);
+	}
+	if (options.verbose) {
+		std::cerr << input << ": " << labels.size() << " taxa, "
+				<< phylo.getPrecision() << " digits, "
+				<< phylo.numPolytomies() << " polytomies";
+		// Trees of compact storage are approximate
+		const char* storages[] = {"double", "float", "fixed"};
+		if (phylo.getStorage() != DOUBLE_STORAGE) {
+			std::cerr << ", " << storages[phylo.getStorage()]
+					<< " storage (approximate)";
+		}
+		std::cerr << "\n";
+	}
+	return;
+}
+
+template <typename T>
+static void writeTree(BasicMatrix<T>&& dist, int digits,
+		const std::vector<std::string>& labels, const std::string& input,
+		const Options& options, std::ostream& out, std::ostream* profile) {
+	BasicPhylogeny<T> phylo(std::move(dist), digits);
+	phylo.setIncrementalSums(options.incremental);
+	phylo.setBoundedSearch(options.bounded);
+	finishTree(phylo, labels, input, options, out, profile);
+	return;
+}
+
+template <typename T>
+static void resumeTree(std::istream& in, const Options& options,
+		std::ostream& out, std::ostream* profile) {
+	// Storage and options of the search are those of the state
+	BasicPhylogeny<T> phylo;
+	std::vector<std::string> labels;
+	phylo.readState(in, labels);
+	finishTree(phylo, labels, options.resume, options, out, profile);
+	return;
+}
+
+static void resume(const Options& options, std::ostream& out,
+		std::ostream* profile) {
+	std::ifstream in(options.resume.c_str(), std::ios::binary);
+	if (!in) {
+		throw std::runtime_error("cannot open " + options.resume);
+	}
+	Storage storage = stateStorage(in);
+	if (storage == FIXED_STORAGE) {
+		resumeTree<int32_t>(in, options, out, profile);
+	} else if (storage == FLOAT_STORAGE) {
+		resumeTree<float>(in, options, out, profile);
+	} else {
+		resumeTree<double>(in, options, out, profile);
+	}
+	return;
+}
+
+static void reconstruct(const std::string& input, const Options& options,
+		std::ostream& out, std::ostream* profile) {
+	// Binary files are mapped, and must outlive the reconstruction
+	std::unique_ptr<DistanceFile> file;
+	DistanceReader reader;
+	std::vector<std::string> labels;
+	Matrix dist;
+	if ((input != "-") && DistanceFile::isDistanceFile(input)) {
+		// Compact storage only reads the file, which is left valid
+		file.reset(new DistanceFile(input,
+				options.inPlace && (options.storage == "double")));
+		dist = Matrix(file->values(), file->numValues(), true);
+		labels = file->getLabels();
+	} else if (!options.model.empty()) {
+		readAlignment(input, options, dist, labels);
+	} else {
+		readText(input, reader);
+		dist = std::move(reader.getDistances());
+		labels = reader.getLabels();
+	}
+	if (labels.size() < 3) {
+		throw std::runtime_error("the number of taxa must be at least 3");
+	}
+	// Precisions are limited to the maximum of the distances, as in R, before
+	// the scale of compact storage is chosen from them
+	std::vector<int> precisions(1, options.digits);
+	effectivePrecisions(dist, precisions, options.threads);
+	int digits = precisions.front();
+	// Compact distances are converted before the reconstruction, and both
+	// compact storages fall back to double if the precision does not fit
+	double scale = 0.0;
+	if (options.storage == "fixed") {
+		scale = fixedScale(dist, digits);
+	} else if (options.storage == "float") {
+		scale = floatScale(dist, digits);
+	}
+	if ((scale > 0.0) && (options.storage == "fixed")) {
+		FixedMatrix fixed(dist, scale);
+		dist = Matrix();
+		writeTree(std::move(fixed), digits, labels, input, options, out,
+				profile);
+	} else if (scale > 0.0) {
+		FloatMatrix single(dist, scale);
+		dist = Matrix();
+		writeTree(std::move(single), digits, labels, input, options, out,
+				profile);
+	} else {
+		writeTree(std::move(dist), digits, labels, input, options, out,
+				profile);
+	}
+	return;
+}
+
+int main(int argc, char** argv) {
+	int status = EXIT_SUCCESS;
+	try {
+		Options options = parseOptions(argc, argv);
+		if (!options.binary.empty() && !options.model.empty()) {
+			Matrix dist;
+			std::vector<std::string> labels;
+			readAlignment(options.inputs.front(), options, dist, labels);
+			DistanceFile::write(options.binary, dist, labels);
+		} else if (!options.binary.empty()) {
+			DistanceReader reader;
+			readText(options.inputs.front(), reader);
+			DistanceFile::write(options.binary, reader.getDistances(),
+					reader.getLabels());
+		} else {
+			std::ofstream file;
+			if (!options.output.empty()) {
+				file.open(options.output.c_str());
+				if (!file) {
+					throw std::runtime_error("cannot write " + options.output);
+				}
+			}
+			std::ostream& out = options.output.empty()? std::cout : file;
+			std::ofstream profileFile;
+			std::ostream* profile = nullptr;
+			if (!options.profile.empty()) {
+				profileFile.open(options.profile.c_str());
+				if (!profileFile) {
+					throw std::runtime_error("cannot write " + options.profile);
+				}
+				profileFile << "input\tround\totus\tties\tmergers\tlargest"
+						<< "\tbytes\tsums\tminimize\tconnect\tagglomerate"
+						<< "\tupdate\n";
+				profile = &profileFile;
+			}
+			if (!options.checkpoint.empty()) {
+				std::signal(SIGINT, handleSignal);
+				std::signal(SIGTERM, handleSignal);
+#ifdef SIGUSR1
+				std::signal(SIGUSR1, handleSignal);
+#endif
+			}
+			if (!options.resume.empty()) {
+				resume(options, out, profile);
+			}
+			for (std::size_t f = 0; f < options.inputs.size(); f ++) {
+				reconstruct(options.inputs[f], options, out, profile);
+			}
+			out.flush();
+			if (!out) {
+				throw std::runtime_error("error writing the trees");
+			}
+			if ((profile != nullptr) && !profile->flush()) {
+				throw std::runtime_error("error writing " + options.profile);
+			}
+		}
+	} catch (const std::exception& e) {
+		std::cerr << "mfnj: " << e.what() << "\n";
+		status = EXIT_FAILURE;
+	}
+	return status;
+}
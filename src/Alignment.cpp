@@ -0,0 +1,273 @@
+#include "Alignment.h"
+
+#include <cctype>  // std::isspace, std::toupper
+#include <cmath>  // std::isnan, std::log
+#include <cstdint>  // int64_t, uint64_t
+#include <cstring>  // std::strchr
+#include <istream>  // std::istream
+#include <sstream>  // std::istringstream
+#include <stdexcept>  // std::runtime_error
+#include <string>  // std::getline, std::string, std::to_string
+#include <vector>  // std::vector
+
+#include "Matrix.h"
+#include "Popcount.h"
+
+// Bases of the packed sequences, or missing sites
+static const int BASE_A = 0;
+static const int BASE_C = 1;
+static const int BASE_G = 2;
+static const int BASE_T = 3;
+static const int MISSING = -1;
+
+// Ambiguous bases and gaps of the text of sequences
+static const char* MISSING_CHARS = "RYKMSWBDHVNX-?.";
+
+Alignment::Alignment() {
+	this->nSites = 0;
+	this->nWords = 0;
+}
+
+void Alignment::read(std::istream& in) {
+	// Sequences in FASTA format, labelled by the first word of their headers
+	// and split into any number of lines
+	std::string line;
+	std::string label;
+	std::string bases;
+	bool inSequence = false;
+	while (std::getline(in, line)) {
+		if (!line.empty() && (line[0] == '>')) {
+			if (inSequence) {
+				addSequence(label, bases.data(), bases.size());
+			}
+			std::istringstream header(line.substr(1));
+			label.clear();
+			header >> label;
+			if (label.empty()) {
+				throw std::runtime_error("sequence "
+						+ std::to_string(this->labels.size() + 1)
+						+ " has no label");
+			}
+			bases.clear();
+			inSequence = true;
+		} else {
+			for (std::size_t c = 0; c < line.size(); c ++) {
+				if (!std::isspace((unsigned char)line[c])) {
+					if (!inSequence) {
+						throw std::runtime_error("not a FASTA file");
+					}
+					bases.push_back(line[c]);
+				}
+			}
+		}
+	}
+	if (inSequence) {
+		addSequence(label, bases.data(), bases.size());
+	}
+	if (this->labels.empty()) {
+		throw std::runtime_error("empty alignment");
+	}
+	return;
+}
+
+void Alignment::addSequence(const std::string& label, const char* bases,
+		int64_t nSites) {
+	// Uracil is read as thymine, and letters are case insensitive
+	startSequence(label, nSites);
+	for (int64_t s = 0; s < nSites; s ++) {
+		char c = (char)std::toupper((unsigned char)bases[s]);
+		int base;
+		if (c == 'A') {
+			base = BASE_A;
+		} else if (c == 'C') {
+			base = BASE_C;
+		} else if (c == 'G') {
+			base = BASE_G;
+		} else if ((c == 'T') || (c == 'U')) {
+			base = BASE_T;
+		} else if ((c != '\0') && (std::strchr(MISSING_CHARS, c) != nullptr)) {
+			base = MISSING;
+		} else {
+			throw std::runtime_error("invalid base '" + std::string(1, bases[s])
+					+ "' in sequence " + label);
+		}
+		setBase(s, base);
+	}
+	return;
+}
+
+void Alignment::addCodes(const std::string& label, const unsigned char* codes,
+		int64_t nSites, int64_t stride) {
+	// Bit-level coding of package ape, where only A, G, C and T have the bit of
+	// known bases. Sites of the sequence are stride codes apart
+	startSequence(label, nSites);
+	for (int64_t s = 0; s < nSites; s ++) {
+		unsigned char code = codes[s * stride];
+		int base = MISSING;
+		if (code == 0x88) {
+			base = BASE_A;
+		} else if (code == 0x28) {
+			base = BASE_C;
+		} else if (code == 0x48) {
+			base = BASE_G;
+		} else if (code == 0x18) {
+			base = BASE_T;
+		}
+		setBase(s, base);
+	}
+	return;
+}
+
+const std::vector<std::string>& Alignment::getLabels() const {
+	return this->labels;
+}
+
+int64_t Alignment::numSequences() const {
+	return this->labels.size();
+}
+
+int64_t Alignment::numSites() const {
+	return this->nSites;
+}
+
+Matrix Alignment::distances(DistanceModel model, bool pairwiseDeletion,
+		int threads) const {
+	// Sites missing in any sequence are removed from all of them, unless they
+	// are only removed from the pairs of sequences where they are missing
+	int64_t n = numSequences();
+	std::vector<uint64_t> mask(this->nWords, ~(uint64_t)0);
+	if (!pairwiseDeletion) {
+		for (int64_t i = 0; i < n; i ++) {
+			const uint64_t* ki = this->known.data() + i * this->nWords;
+			for (int64_t w = 0; w < this->nWords; w ++) {
+				mask[w] &= ki[w];
+			}
+		}
+	}
+	// Columns are computed in parallel, and undefined distances are reported
+	// for the first pair in the order of the matrix
+	Matrix dist(n);
+	int64_t undefinedI = -1;
+	int64_t undefinedJ = -1;
+#ifdef _OPENMP
+	#pragma omp parallel for num_threads(threads) if (threads > 1) \
+			schedule(dynamic, 1)
+#endif
+	for (int64_t j = 0; j < n; j ++) {
+		for (int64_t i = j + 1; i < n; i ++) {
+			double dij = distance(i, j, mask.data(), model);
+			if (std::isnan(dij)) {
+#ifdef _OPENMP
+				#pragma omp critical
+#endif
+				if ((undefinedJ < 0) || (j < undefinedJ)
+						|| ((j == undefinedJ) && (i < undefinedI))) {
+					undefinedI = i;
+					undefinedJ = j;
+				}
+				dij = 0.0;
+			}
+			dist.setValue(i, j, dij);
+		}
+	}
+	if (undefinedJ >= 0) {
+		throw std::runtime_error("distance between "
+				+ this->labels[undefinedJ] + " and " + this->labels[undefinedI]
+				+ " is not defined: no sites to compare, or too many"
+				" differences for the model");
+	}
+	return dist;
+}
+
+DistanceModel Alignment::parseModel(const std::string& name) {
+	DistanceModel model;
+	if (name == "raw") {
+		model = RAW_MODEL;
+	} else if (name == "JC69") {
+		model = JC69_MODEL;
+	} else if (name == "K80") {
+		model = K80_MODEL;
+	} else {
+		throw std::runtime_error("unknown model " + name
+				+ ": it must be raw, JC69 or K80");
+	}
+	return model;
+}
+
+void Alignment::startSequence(const std::string& label, int64_t nSites) {
+	if (this->labels.empty()) {
+		this->nSites = nSites;
+		this->nWords = (nSites + 63) / 64;
+	} else if (nSites != this->nSites) {
+		throw std::runtime_error("sequence " + label + " has "
+				+ std::to_string(nSites) + " sites instead of "
+				+ std::to_string(this->nSites));
+	}
+	this->labels.push_back(label);
+	this->known.resize(this->known.size() + this->nWords, 0);
+	this->purines.resize(this->purines.size() + this->nWords, 0);
+	this->ketos.resize(this->ketos.size() + this->nWords, 0);
+	return;
+}
+
+void Alignment::setBase(int64_t site, int base) {
+	// Site of the last sequence. A and G are purines, and G and T are keto
+	// bases, so that transversions change the purine bit and transitions only
+	// change the keto bit
+	if (base != MISSING) {
+		int64_t w = (numSequences() - 1) * this->nWords + site / 64;
+		uint64_t bit = (uint64_t)1 << (site % 64);
+		this->known[w] |= bit;
+		if ((base == BASE_A) || (base == BASE_G)) {
+			this->purines[w] |= bit;
+		}
+		if ((base == BASE_G) || (base == BASE_T)) {
+			this->ketos[w] |= bit;
+		}
+	}
+	return;
+}
+
+double Alignment::distance(int64_t i, int64_t j, const uint64_t* mask,
+		DistanceModel model) const {
+	// Sites compared, transitions and transversions are counted word by word,
+	// and the distance is NaN if it is not defined
+	const uint64_t* ki = this->known.data() + i * this->nWords;
+	const uint64_t* kj = this->known.data() + j * this->nWords;
+	const uint64_t* pi = this->purines.data() + i * this->nWords;
+	const uint64_t* pj = this->purines.data() + j * this->nWords;
+	const uint64_t* qi = this->ketos.data() + i * this->nWords;
+	const uint64_t* qj = this->ketos.data() + j * this->nWords;
+	int64_t nCompared = 0;
+	int64_t nTransitions = 0;
+	int64_t nTransversions = 0;
+	for (int64_t w = 0; w < this->nWords; w ++) {
+		uint64_t compared = ki[w] & kj[w] & mask[w];
+		uint64_t transversions = (pi[w] ^ pj[w]) & compared;
+		uint64_t transitions = (qi[w] ^ qj[w]) & compared & ~transversions;
+		nCompared += popcount(compared);
+		nTransversions += popcount(transversions);
+		nTransitions += popcount(transitions);
+	}
+	double dij = NOT_A_NUMBER;
+	if (nCompared > 0) {
+		double p = (double)nTransitions / (double)nCompared;
+		double q = (double)nTransversions / (double)nCompared;
+		if (model == RAW_MODEL) {
+			dij = p + q;
+		} else if (model == JC69_MODEL) {
+			double a = 1.0 - 4.0 * (p + q) / 3.0;
+			if (a > 0.0) {
+				dij = -0.75 * std::log(a);
+			}
+		} else {
+			double a1 = 1.0 - 2.0 * p - q;
+			double a2 = 1.0 - 2.0 * q;
+			if ((a1 > 0.0) && (a2 > 0.0)) {
+				dij = -0.5 * std::log(a1) - 0.25 * std::log(a2);
+			}
+		}
+		dij += 0.0;  // identical sequences are at 0, not at -0
+	}
+	return dij;
+}
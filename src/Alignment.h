@@ -0,0 +1,48 @@
+#ifndef ALIGNMENT_H_
+#define ALIGNMENT_H_
+
+#include <cstdint>  // int64_t, uint64_t
+#include <istream>  // std::istream
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+#include "Matrix.h"
+
+// Models of evolution of the distances between DNA sequences
+enum DistanceModel {
+    RAW_MODEL,  // Proportion of different sites
+    JC69_MODEL,  // Jukes and Cantor (1969)
+    K80_MODEL  // Kimura (1980), with transitions and transversions
+};
+
+// Aligned DNA sequences packed in bits, 64 sites per word, whose pairwise
+// distances are counted with population counts of the words. Ambiguous bases
+// and gaps are missing sites
+class Alignment {
+public:
+    Alignment();
+    void read(std::istream& in);
+    void addSequence(const std::string& label, const char* bases,
+    		int64_t nSites);
+    void addCodes(const std::string& label, const unsigned char* codes,
+    		int64_t nSites, int64_t stride);
+    const std::vector<std::string>& getLabels() const;
+    int64_t numSequences() const;
+    int64_t numSites() const;
+    Matrix distances(DistanceModel model, bool pairwiseDeletion,
+    		int threads = 1) const;
+    static DistanceModel parseModel(const std::string& name);
+private:
+    int64_t nSites;  // Number of sites of every sequence
+    int64_t nWords;  // Words of every sequence
+    std::vector<std::string> labels;  // Labels of the sequences
+    std::vector<uint64_t> known;  // Sites with A, C, G or T
+    std::vector<uint64_t> purines;  // Sites with A or G
+    std::vector<uint64_t> ketos;  // Sites with G or T
+    void startSequence(const std::string& label, int64_t nSites);
+    void setBase(int64_t site, int base);
+    double distance(int64_t i, int64_t j, const uint64_t* mask,
+    		DistanceModel model) const;
+};
+
+#endif /* ALIGNMENT_H_ */
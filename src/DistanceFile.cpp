@@ -0,0 +1,290 @@
+#include "DistanceFile.h"
+
+#include <algorithm>  // std::binary_search, std::sort
+#include <cstdint>  // int64_t, uint32_t
+#include <cstdio>  // std::remove
+#include <cstring>  // std::memcmp, std::memcpy, std::strerror
+#include <fstream>  // std::ifstream, std::ofstream
+#include <ostream>  // std::ostream
+#include <stdexcept>  // std::runtime_error
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+#include "Matrix.h"
+#include "TemporaryFile.h"
+
+#ifndef _WIN32
+#include <cerrno>  // errno
+#include <fcntl.h>  // open
+#include <sys/mman.h>  // mmap, msync, munmap
+#include <sys/stat.h>  // fstat
+#include <unistd.h>  // close
+#endif
+
+static const char FILE_MAGIC[8] = {'M', 'F', 'N', 'J', 'D', 'I', 'S', 'T'};
+static const uint32_t FILE_VERSION = 1;
+static const uint32_t ENDIANNESS = 0x01020304;
+
+DistanceFile::Header::Header() {
+	std::memcpy(this->magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+	this->version = FILE_VERSION;
+	this->byteOrder = ENDIANNESS;
+	this->nRows = 0;
+	this->nValues = 0;
+	this->valuesOffset = sizeof(Header);
+	this->labelsOffset = sizeof(Header);
+	this->labelsSize = 0;
+	this->consumed = 0;
+}
+
+DistanceFile::DistanceFile(const std::string& path, bool inPlace) {
+	// Values are updated in the file if inPlace, or else in private copies of
+	// the pages modified, which leave the file untouched. Files updated in
+	// place are rejected afterwards
+	this->address = nullptr;
+	this->size = 0;
+	this->data = nullptr;
+	this->nValues = 0;
+#ifdef _WIN32
+	(void)inPlace;
+	throw std::runtime_error("memory-mapped distance files are not supported "
+			"on Windows: " + path);
+#else
+	int fd = open(path.c_str(), inPlace? O_RDWR : O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("cannot open " + path + ": "
+				+ std::strerror(errno));
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("cannot read " + path);
+	}
+	this->size = st.st_size;
+	if (this->size < (int64_t)sizeof(Header)) {
+		close(fd);
+		throw std::runtime_error("not a distance file: " + path);
+	}
+	this->address = mmap(nullptr, this->size, PROT_READ | PROT_WRITE,
+			inPlace? MAP_SHARED : MAP_PRIVATE, fd, 0);
+	close(fd);  // the mapping remains
+	if (this->address == MAP_FAILED) {
+		this->address = nullptr;
+		throw std::runtime_error("cannot map " + path + ": "
+				+ std::strerror(errno));
+	}
+	Header header;
+	std::memcpy(&header, this->address, sizeof(Header));
+	std::string error;
+	if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+		error = "not a distance file";
+	} else if (header.version != FILE_VERSION) {
+		error = "unsupported version of distance file";
+	} else if (header.byteOrder != ENDIANNESS) {
+		error = "distance file written with another byte order";
+	} else if (header.consumed != 0) {
+		error = "distance file updated in place by a reconstruction";
+	} else if ((header.nRows < 0)
+			|| (header.nValues != header.nRows * (header.nRows - 1) / 2)
+			|| (header.valuesOffset % sizeof(double) != 0)
+			|| (header.valuesOffset + header.nValues * (int64_t)sizeof(double)
+					> header.labelsOffset)
+			|| (header.labelsOffset + header.labelsSize > this->size)) {
+		error = "corrupted distance file";
+	}
+	if (!error.empty()) {
+		munmap(this->address, this->size);
+		this->address = nullptr;
+		throw std::runtime_error(error + ": " + path);
+	}
+	char* bytes = (char*)this->address;
+	this->data = (double*)(bytes + header.valuesOffset);
+	this->nValues = header.nValues;
+	const char* label = bytes + header.labelsOffset;
+	const char* end = label + header.labelsSize;
+	this->labels.reserve(header.nRows);
+	while ((label < end) && ((int64_t)this->labels.size() < header.nRows)) {
+		const char* labelEnd = label;
+		while ((labelEnd < end) && (*labelEnd != '\0')) {
+			labelEnd ++;
+		}
+		this->labels.push_back(std::string(label, labelEnd));
+		label = labelEnd + 1;
+	}
+	if ((int64_t)this->labels.size() != header.nRows) {
+		munmap(this->address, this->size);
+		this->address = nullptr;
+		throw std::runtime_error("corrupted labels of distance file: " + path);
+	}
+	// The header is marked and written to disk before any distance changes,
+	// so that the file is rejected even if the reconstruction never finishes
+	if (inPlace) {
+		header.consumed = 1;
+		std::memcpy(this->address, &header, sizeof(Header));
+		if (msync(this->address, sizeof(Header), MS_SYNC) != 0) {
+			munmap(this->address, this->size);
+			this->address = nullptr;
+			throw std::runtime_error("cannot write " + path + ": "
+					+ std::strerror(errno));
+		}
+	}
+#endif
+}
+
+DistanceFile::~DistanceFile() {
+#ifndef _WIN32
+	if (this->address != nullptr) {
+		munmap(this->address, this->size);
+	}
+#endif
+}
+
+double* DistanceFile::values() const {
+	return this->data;
+}
+
+int64_t DistanceFile::numValues() const {
+	return this->nValues;
+}
+
+const std::vector<std::string>& DistanceFile::getLabels() const {
+	return this->labels;
+}
+
+bool DistanceFile::isDistanceFile(const std::string& path) {
+	char magic[sizeof(FILE_MAGIC)];
+	std::ifstream in(path.c_str(), std::ios::binary);
+	bool isFile = in.read(magic, sizeof(FILE_MAGIC))
+			&& (std::memcmp(magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0);
+	return isFile;
+}
+
+void DistanceFile::write(const std::string& path, const double* values,
+		int64_t nValues, const std::vector<std::string>& labels) {
+	Header hdr = header(nValues, labels);
+	std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!out) {
+		throw std::runtime_error("cannot create " + path);
+	}
+	out.write((const char*)&hdr, sizeof(Header));
+	out.write((const char*)values, nValues * sizeof(double));
+	writeLabels(out, labels);
+	out.close();
+	if (!out) {
+		throw std::runtime_error("cannot write " + path);
+	}
+	return;
+}
+
+void DistanceFile::write(const std::string& path, const Matrix& dist,
+		const std::vector<std::string>& labels) {
+	// Values below the diagonal are contiguous in every column
+	int64_t n = dist.numRows();
+	Header hdr = header(n * (n - 1) / 2, labels);
+	std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!out) {
+		throw std::runtime_error("cannot create " + path);
+	}
+	out.write((const char*)&hdr, sizeof(Header));
+	for (int64_t j = 0; j + 1 < n; j ++) {
+		const double* dj = dist.column(j);
+		out.write((const char*)(dj + j + 1), (n - j - 1) * sizeof(double));
+	}
+	writeLabels(out, labels);
+	out.close();
+	if (!out) {
+		throw std::runtime_error("cannot write " + path);
+	}
+	return;
+}
+
+void DistanceFile::append(const std::string& path, const double* rows,
+		const std::vector<std::string>& labels) {
+	// New taxa go after the n taxa of the file, and rows holds the distances
+	// of every new taxon to all n + k taxa. Every column of the lower triangle
+	// gains the distances to the new taxa, so the file is rewritten into a
+	// temporary one of its own, which then replaces it with a rename, so
+	// that readers and concurrent appends never find it partially written
+	std::string temporary = temporaryPath(path);
+	{
+		DistanceFile file(path, false);
+		int64_t n = file.getLabels().size();
+		int64_t k = labels.size();
+		int64_t m = n + k;
+		std::vector<std::string> allLabels(file.getLabels());
+		allLabels.insert(allLabels.end(), labels.begin(), labels.end());
+		// New labels must not repeat each other or those of the file
+		std::vector<std::string> known(file.getLabels());
+		std::sort(known.begin(), known.end());
+		std::vector<std::string> added(labels);
+		std::sort(added.begin(), added.end());
+		for (std::size_t a = 0; a < added.size(); a ++) {
+			if (std::binary_search(known.begin(), known.end(), added[a])) {
+				throw std::runtime_error("label " + added[a]
+						+ " of a new taxon is already in " + path);
+			} else if ((a > 0) && (added[a] == added[a - 1])) {
+				throw std::runtime_error("label " + added[a]
+						+ " is repeated in the new taxa");
+			}
+		}
+		Header hdr = header(m * (m - 1) / 2, allLabels);
+		std::ofstream out(temporary.c_str(),
+				std::ios::binary | std::ios::trunc);
+		if (!out) {
+			throw std::runtime_error("cannot create " + temporary);
+		}
+		out.write((const char*)&hdr, sizeof(Header));
+		std::vector<double> column(k);
+		const double* values = file.values();
+		for (int64_t j = 0; j < m - 1; j ++) {
+			if (j < n) {
+				// Column j of the file, followed by the new taxa
+				out.write((const char*)values, (n - j - 1) * sizeof(double));
+				values += n - j - 1;
+				for (int64_t a = 0; a < k; a ++) {
+					column[a] = rows[a * m + j];
+				}
+				out.write((const char*)column.data(), k * sizeof(double));
+			} else {
+				// Column of a new taxon, below the diagonal
+				int64_t b = j - n;
+				for (int64_t a = b + 1; a < k; a ++) {
+					column[a - b - 1] = rows[a * m + j];
+				}
+				out.write((const char*)column.data(),
+						(k - b - 1) * sizeof(double));
+			}
+		}
+		writeLabels(out, allLabels);
+		out.close();
+		if (!out) {
+			std::remove(temporary.c_str());
+			throw std::runtime_error("cannot write " + temporary);
+		}
+	}
+	replaceFile(temporary, path);
+	return;
+}
+
+DistanceFile::Header DistanceFile::header(int64_t nValues,
+		const std::vector<std::string>& labels) {
+	Header hdr;
+	hdr.nRows = labels.size();
+	hdr.nValues = nValues;
+	if (hdr.nValues != hdr.nRows * (hdr.nRows - 1) / 2) {
+		throw std::runtime_error("number of distances and labels do not match");
+	}
+	hdr.labelsOffset = hdr.valuesOffset + hdr.nValues * (int64_t)sizeof(double);
+	for (std::size_t i = 0; i < labels.size(); i ++) {
+		hdr.labelsSize += labels[i].size() + 1;
+	}
+	return hdr;
+}
+
+void DistanceFile::writeLabels(std::ostream& out,
+		const std::vector<std::string>& labels) {
+	for (std::size_t i = 0; i < labels.size(); i ++) {
+		out.write(labels[i].c_str(), labels[i].size() + 1);
+	}
+	return;
+}
@@ -0,0 +1,54 @@
+#ifndef DISTANCEFILE_H_
+#define DISTANCEFILE_H_
+
+#include <cstdint>  // int64_t, uint32_t
+#include <ostream>  // std::ostream
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+#include "Matrix.h"
+
+// Binary file of distances mapped into memory, whose lower triangular values
+// are stored by columns as in Matrix, followed by the labels of the taxa
+class DistanceFile {
+public:
+    DistanceFile(const std::string& path, bool inPlace);
+    DistanceFile(const DistanceFile& other) = delete;
+    DistanceFile& operator=(const DistanceFile& other) = delete;
+    ~DistanceFile();
+    double* values() const;
+    int64_t numValues() const;
+    const std::vector<std::string>& getLabels() const;
+    static bool isDistanceFile(const std::string& path);
+    static void write(const std::string& path, const double* values,
+    		int64_t nValues, const std::vector<std::string>& labels);
+    static void write(const std::string& path, const Matrix& dist,
+    		const std::vector<std::string>& labels);
+    static void append(const std::string& path, const double* rows,
+    		const std::vector<std::string>& labels);
+private:
+    class Header {
+    public:
+    	Header();
+    	char magic[8];  // File signature
+    	uint32_t version;  // Version of the format
+    	uint32_t byteOrder;  // Byte order of the machine that wrote the file
+    	int64_t nRows;  // Number of taxa
+    	int64_t nValues;  // Number of lower triangular values
+    	int64_t valuesOffset;  // Offset of the values
+    	int64_t labelsOffset;  // Offset of the labels, ended by '\0'
+    	int64_t labelsSize;  // Size of the labels
+    	int64_t consumed;  // Nonzero once updated in place
+    };
+    static Header header(int64_t nValues,
+    		const std::vector<std::string>& labels);
+    static void writeLabels(std::ostream& out,
+    		const std::vector<std::string>& labels);
+    void* address;  // Address of the mapping
+    int64_t size;  // Size of the mapping
+    double* data;  // Lower triangular values by columns
+    int64_t nValues;  // Number of lower triangular values
+    std::vector<std::string> labels;  // Labels of the taxa
+};
+
+#endif /* DISTANCEFILE_H_ */
@@ -1,89 +1,465 @@
 #include "Matrix.h"
 
 #include <algorithm>  // std::max, std::min
-#include <cmath>  // std::round, std::sqrt
-#include <sstream>  // std::ostringstream
-#include <string>  // std::string
+#include <cmath>  // std::abs, std::floor, std::log10, std::pow, std::round,
+                  // std::sqrt
+#include <cstdint>  // int32_t, int64_t
+#include <cstdio>  // std::snprintf
+#include <cstring>  // std::strchr
+#include <istream>  // std::istream
+#include <limits>  // std::numeric_limits
+#include <ostream>  // std::ostream
+#include <stdexcept>  // std::runtime_error
+#include <utility>  // std::move
 #include <vector>  // std::vector
 
-Matrix::Matrix() {}
+template <typename T>
+BasicMatrix<T>::BasicMatrix() {
+	this->nRows = 0;
+	this->nValues = 0;
+	this->data = nullptr;
+	this->scale = 1.0;
+	this->unitValue = 1.0;
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(const BasicMatrix& other) {
+	this->nRows = other.nRows;
+	this->nValues = other.nValues;
+	this->values.assign(other.data, other.data + other.nValues);
+	this->data = this->values.data();
+	this->offsets = other.offsets;
+	this->scale = other.scale;
+	this->unitValue = other.unitValue;
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(BasicMatrix&& other) {
+	this->nRows = other.nRows;
+	this->nValues = other.nValues;
+	this->values = std::move(other.values);
+	// Values not owned by other remain where they are
+	this->data = this->values.empty()? other.data : this->values.data();
+	this->offsets = std::move(other.offsets);
+	this->scale = other.scale;
+	this->unitValue = other.unitValue;
+	other.nRows = 0;
+	other.nValues = 0;
+	other.data = nullptr;
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(const std::vector<double>& values)
+		: BasicMatrix(values.data(), values.size()) {
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(std::vector<double>&& values)
+		: BasicMatrix(values.data(), values.size()) {
+}
 
-Matrix::Matrix(const Matrix& other) {
-	this->values = other.values;
+template <>
+BasicMatrix<double>::BasicMatrix(std::vector<double>&& values)
+		: BasicMatrix() {
+	this->nValues = values.size();
+	this->values = std::move(values);
+	this->data = this->values.data();
+	initRows();
 }
 
-Matrix::Matrix(const std::vector<double>& values) {
-	this->values = values;
+template <typename T>
+BasicMatrix<T>::BasicMatrix(const double* values, int64_t nValues)
+		: BasicMatrix() {
+	this->nValues = nValues;
+	this->values.resize(nValues);
+	for (int64_t i = 0; i < nValues; i ++) {
+		this->values[i] = encode(values[i]);
+	}
+	this->data = this->values.data();
+	initRows();
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(double* values, int64_t nValues, bool)
+		: BasicMatrix((const double*)values, nValues) {
+	// Compact values are converted, and never used in place
 }
 
-Matrix::Matrix(int nRows) {
-	int nValues = (nRows - 1) * nRows / 2;
-	this->values = std::vector<double>(nValues, NOT_A_NUMBER);
+template <>
+BasicMatrix<double>::BasicMatrix(double* values, int64_t nValues,
+		bool inPlace) : BasicMatrix() {
+	this->nValues = nValues;
+	if (inPlace) {
+		// Values are modified where they are, and must outlive the matrix
+		this->data = values;
+	} else {
+		this->values.assign(values, values + nValues);
+		this->data = this->values.data();
+	}
+	initRows();
 }
 
-void Matrix::setValue(int i, int j, double value) {
+template <typename T>
+BasicMatrix<T>::BasicMatrix(const BasicMatrix<double>& other, double scale)
+		: BasicMatrix() {
+	// Values of other are converted into a matrix of its own
+	this->nRows = other.nRows;
+	this->nValues = other.nValues;
+	this->offsets = other.offsets;
+	this->scale = scale;
+	this->unitValue = 1.0 / scale;
+	this->values.resize(this->nValues);
+	for (int64_t i = 0; i < this->nValues; i ++) {
+		this->values[i] = encode(other.data[i]);
+	}
+	this->data = this->values.data();
+}
+
+template <typename T>
+BasicMatrix<T>::BasicMatrix(int64_t nRows) : BasicMatrix() {
+	this->nRows = nRows;
+	this->nValues = (nRows - 1) * nRows / 2;
+	this->values = std::vector<T>(this->nValues,
+			std::numeric_limits<T>::quiet_NaN());
+	this->data = this->values.data();
+	initOffsets();
+}
+
+template <typename T>
+BasicMatrix<T>& BasicMatrix<T>::operator=(const BasicMatrix& other) {
+	if (this != &other) {
+		this->nRows = other.nRows;
+		this->nValues = other.nValues;
+		this->values.assign(other.data, other.data + other.nValues);
+		this->data = this->values.data();
+		this->offsets = other.offsets;
+		this->scale = other.scale;
+		this->unitValue = other.unitValue;
+	}
+	return *this;
+}
+
+template <typename T>
+BasicMatrix<T>& BasicMatrix<T>::operator=(BasicMatrix&& other) {
+	if (this != &other) {
+		this->nRows = other.nRows;
+		this->nValues = other.nValues;
+		this->values = std::move(other.values);
+		this->data = this->values.empty()? other.data : this->values.data();
+		this->offsets = std::move(other.offsets);
+		this->scale = other.scale;
+		this->unitValue = other.unitValue;
+		other.nRows = 0;
+		other.nValues = 0;
+		other.data = nullptr;
+	}
+	return *this;
+}
+
+template <typename T>
+void BasicMatrix<T>::setValue(int64_t i, int64_t j, double value) {
 	if (i != j) {
-		this->values[index(i, j)] = value;
+		this->data[index(i, j)] = encode(value);
 	}
 	return;
 }
 
-double Matrix::value(int i, int j) const {
+template <typename T>
+double BasicMatrix<T>::value(int64_t i, int64_t j) const {
 	double vij;
 	if (i == j) {
 		vij = NOT_A_NUMBER;
 	} else {
-		vij = this->values[index(i, j)];
+		vij = (double)this->data[index(i, j)] * this->unitValue;
 	}
 	return vij;
 }
 
-double Matrix::minValue() const {
+template <typename T>
+const T* BasicMatrix<T>::column(int64_t j) const {
+	// Values (i, j) below the diagonal are contiguous and indexed by i > j.
+	// They are stored values, to be multiplied by unit()
+	return this->data + this->offsets[j];
+}
+
+template <typename T>
+void BasicMatrix<T>::compact(const std::vector<int64_t>& rows) {
+	// Values between the given rows, in increasing order, are moved to the
+	// front of the same storage as a smaller matrix. No value moves after its
+	// old position, so the columns are moved in order without any buffer
+	int64_t nKept = rows.size();
+	int64_t k = 0;
+	for (int64_t b = 0; b < nKept; b ++) {
+		const T* from = this->data + this->offsets[rows[b]];
+		for (int64_t a = b + 1; a < nKept; a ++) {
+			this->data[k] = from[rows[a]];
+			k ++;
+		}
+	}
+	this->nRows = nKept;
+	this->nValues = k;
+	initOffsets();
+	return;
+}
+
+template <typename T>
+double BasicMatrix<T>::unit() const {
+	return this->unitValue;
+}
+
+template <typename T>
+double BasicMatrix<T>::minValue() const {
 	double minv = +INF;
-	for (int i = 0; i < (int)this->values.size(); i ++) {
-		minv = std::min(minv, this->values[i]);
+	for (int64_t i = 0; i < this->nValues; i ++) {
+		minv = std::min(minv, (double)this->data[i] * this->unitValue);
 	}
 	return minv;
 }
 
-double Matrix::maxValue() const {
+template <typename T>
+double BasicMatrix<T>::maxValue() const {
 	double maxv = -INF;
-	for (int i = 0; i < (int)this->values.size(); i ++) {
-		maxv = std::max(maxv, this->values[i]);
+	for (int64_t i = 0; i < this->nValues; i ++) {
+		maxv = std::max(maxv, (double)this->data[i] * this->unitValue);
 	}
 	return maxv;
 }
 
-int Matrix::numRows() const {
-	int nValues = (int)this->values.size();
-	return (1 + (int)std::round(std::sqrt((double)(1 + 8 * nValues)))) / 2;
+template <typename T>
+int64_t BasicMatrix<T>::numRows() const {
+	return this->nRows;
+}
+
+template <typename T>
+int64_t BasicMatrix<T>::bytes() const {
+	// Values used in place belong to their owner, and are not counted
+	return sizeof(T) * this->values.capacity()
+			+ sizeof(int64_t) * this->offsets.capacity();
 }
 
-int Matrix::precision() const {
-	std::ostringstream oss;
-	oss.precision(MAX_DIGITS);  // Modify the default precision
+template <typename T>
+void BasicMatrix<T>::write(std::ostream& out) const {
+	// Number of rows, scale and stored values, in the layout of the matrix
+	out.write((const char*)&this->nRows, sizeof(int64_t));
+	out.write((const char*)&this->scale, sizeof(double));
+	out.write((const char*)this->data, this->nValues * sizeof(T));
+	return;
+}
+
+template <typename T>
+void BasicMatrix<T>::read(std::istream& in) {
+	// Values written by write() become owned by the matrix
+	int64_t rows = -1;
+	double factor = 0.0;
+	in.read((char*)&rows, sizeof(int64_t));
+	in.read((char*)&factor, sizeof(double));
+	if (!in || (rows < 0) || !(factor > 0.0)) {
+		throw std::runtime_error("corrupted matrix of distances");
+	}
+	this->nRows = rows;
+	this->nValues = rows * (rows - 1) / 2;
+	this->scale = factor;
+	this->unitValue = 1.0 / factor;
+	this->values.resize(this->nValues);
+	in.read((char*)this->values.data(), this->nValues * sizeof(T));
+	if (!in) {
+		throw std::runtime_error("corrupted matrix of distances");
+	}
+	this->data = this->values.data();
+	initOffsets();
+	return;
+}
+
+template <typename T>
+int BasicMatrix<T>::precision(int threads) const {
+	// Values are scanned by chunks, which are skipped as soon as any value
+	// reaches the maximum number of decimals. The maximum is a reduction, and
+	// only the flag of that early exit is shared by the threads
+	const int64_t chunkSize = 4096;
+	int64_t nChunks = (this->nValues + chunkSize - 1) / chunkSize;
 	int maxDecimals = 0;
-	for (int i = 0; i < (int)this->values.size(); i ++) {
-		oss.str("");  // Clear string stream
-		oss << this->values[i];
-		std::string s = oss.str();
-		std::size_t found = s.find('.');
-		int decimals = (found == std::string::npos)?
-				0 : (int)(s.size() - found) - 1;
-		maxDecimals = std::max(maxDecimals, decimals);
+	int saturated = 0;
+#ifdef _OPENMP
+	#pragma omp parallel for num_threads(threads) if (threads > 1) \
+			schedule(dynamic, 1) reduction(max:maxDecimals)
+#endif
+	for (int64_t c = 0; c < nChunks; c ++) {
+		int skipped;
+#ifdef _OPENMP
+		#pragma omp atomic read
+#endif
+		skipped = saturated;
+		int chunkDecimals = 0;
+		int64_t last = std::min((c + 1) * chunkSize, this->nValues);
+		int64_t i = c * chunkSize;
+		while (!skipped && (i < last) && (chunkDecimals < MAX_DIGITS)) {
+			chunkDecimals = std::max(chunkDecimals,
+					decimals((double)this->data[i] * this->unitValue));
+			i ++;
+		}
+		if (chunkDecimals >= MAX_DIGITS) {
+#ifdef _OPENMP
+			#pragma omp atomic write
+#endif
+			saturated = 1;
+		}
+		maxDecimals = std::max(maxDecimals, chunkDecimals);
 	}
 	return maxDecimals;
 }
 
-int Matrix::index(int i, int j) const {
-	int k;
-	int nRows = numRows();
+template <typename T>
+int BasicMatrix<T>::decimals(double value) {
+	// Number of decimals of value written with MAX_DIGITS significant digits
+	// (at most MAX_DIGITS), as std::ostream or printf("%.15g") would write it
+	const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+			1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+	const double tolerance = 2.0 * std::numeric_limits<double>::epsilon();
+	const int64_t MAX_INTEGER = 100000000000000;  // 10^(MAX_DIGITS - 1)
+	int nDecimals = -1;  // Not known yet
+	double absValue = std::abs(value);
+	if (absValue == 0.0) {
+		nDecimals = 0;
+	} else if ((absValue >= 1e-4) && (absValue < 1e14)) {
+		// Fixed notation: value has d decimals if value 10^d is an integer r,
+		// up to rounding errors, with fewer significant digits than MAX_DIGITS
+		int d = 0;
+		int64_t r = 0;
+		while ((nDecimals < 0) && (d <= MAX_DIGITS) && (r < MAX_INTEGER)) {
+			double scaled = absValue * pow10[d];
+			r = (int64_t)(scaled + 0.5);  // Rounded, since scaled > 0
+			if ((r < MAX_INTEGER) &&
+					(std::abs(scaled - (double)r) <= tolerance * scaled)) {
+				nDecimals = d;
+			}
+			d ++;
+		}
+		// Trailing zeros are not written
+		while ((nDecimals > 0) && (r % 10 == 0)) {
+			r /= 10;
+			nDecimals --;
+		}
+	}
+	if (nDecimals < 0) {
+		// Write the value, without allocations, in the remaining cases
+		char buffer[32];
+		int length = std::snprintf(buffer, sizeof(buffer), "%.*g", MAX_DIGITS,
+				value);
+		const char* point = std::strchr(buffer, '.');
+		nDecimals = (point == nullptr)? 0 : (int)(buffer + length - point) - 1;
+		nDecimals = std::min(nDecimals, MAX_DIGITS);
+	}
+	return nDecimals;
+}
+
+template <typename T>
+T BasicMatrix<T>::encode(double value) const {
+	// Fixed-point values are rounded to the nearest integer
+	double scaled = value * this->scale;
+	if (std::numeric_limits<T>::is_integer) {
+		scaled = std::round(scaled);
+	}
+	return (T)scaled;
+}
+
+template <typename T>
+void BasicMatrix<T>::initRows() {
+	// Solve nValues = (nRows - 1) nRows / 2 only once
+	double n = (double)this->nValues;
+	this->nRows = (1 + (int64_t)std::round(std::sqrt(1.0 + 8.0 * n))) / 2;
+	initOffsets();
+	return;
+}
+
+template <typename T>
+void BasicMatrix<T>::initOffsets() {
+	// Value (i, j), with i > j, is stored at position i + offsets[j]
+	this->offsets = std::vector<int64_t>(std::max(this->nRows, (int64_t)0));
+	for (int64_t j = 0; j < this->nRows; j ++) {
+		this->offsets[j] = j * this->nRows - (j + 1) * (j + 2) / 2;
+	}
+	return;
+}
+
+template <typename T>
+int64_t BasicMatrix<T>::index(int64_t i, int64_t j) const {
+	int64_t k;
 	if (i == j) {
 		k = -1;
 	} else if (i > j) {
-		k = i + j * nRows - (j + 1) * (j + 2) / 2;
+		k = i + this->offsets[j];
 	} else {  // (i < j)
-		k = j + i * nRows - (i + 1) * (i + 2) / 2;
+		k = j + this->offsets[i];
 	}
 	return k;
 }
+
+int effectivePrecisions(const Matrix& dist, std::vector<int>& digits,
+		int threads) {
+	// Negative precisions are detected once
+	int detected = -1;
+	for (std::size_t p = 0; p < digits.size(); p ++) {
+		if (digits[p] < 0) {
+			if (detected < 0) {
+				detected = dist.precision(threads);
+			}
+			digits[p] = detected;
+		}
+	}
+	// Check maximum precision
+	double maxDist = std::max(dist.maxValue(), 1.0);
+	int intDigits = 1 + (int)std::floor(std::log10(maxDist));
+	int maxPrecision = MAX_DIGITS - intDigits - 1;
+	int maxDigits = 0;
+	for (std::size_t p = 0; p < digits.size(); p ++) {
+		digits[p] = std::min(digits[p], maxPrecision);
+		maxDigits = std::max(maxDigits, digits[p]);
+	}
+	return maxDigits;
+}
+
+double fixedScale(const Matrix& dist, int precision) {
+	// Largest power of 10 whose multiples of the distances, and of the new
+	// distances derived from them, fit in 32-bit integers. The unit of
+	// precision has to be exact, otherwise 0 is returned
+	const double maxInteger = std::numeric_limits<int32_t>::max() / 2;
+	double maxDist = std::max(std::abs(dist.minValue()),
+			std::abs(dist.maxValue()));
+	int maxDigits = -1;  // Not even the integer parts fit
+	if (maxDist == 0.0) {
+		maxDigits = MAX_DIGITS;
+	} else if (maxDist <= maxInteger) {
+		maxDigits = (int)std::floor(std::log10(maxInteger / maxDist));
+		maxDigits = std::min(maxDigits, MAX_DIGITS);
+	}
+	double scale = 0.0;
+	if (maxDigits >= std::max(precision, 0)) {
+		scale = std::pow(10.0, (double)maxDigits);
+	}
+	return scale;
+}
+
+double floatScale(const Matrix& dist, int precision) {
+	// Power of 10 of the unit of precision, whose multiples of the distances
+	// are exact integers in single precision. The sums of branch lengths
+	// S_ij = (n - 2) D_ij - R_i - R_j, which reach 3 n times the maximum
+	// distance, must also have at most 6 significant digits at the precision,
+	// so that they keep the unit of precision. The rounding of the new
+	// distances to that unit can still change their ties.
+	// Otherwise 0 is returned
+	const double maxInteger = std::pow(10.0,
+			(double)std::numeric_limits<float>::digits10);
+	double maxDist = std::max(std::abs(dist.minValue()),
+			std::abs(dist.maxValue()));
+	double maxSum = 3.0 * (double)dist.numRows() * maxDist;
+	double scale = std::pow(10.0, (double)std::max(precision, 0));
+	if (maxSum * scale >= maxInteger) {
+		scale = 0.0;
+	}
+	return scale;
+}
+
+// Storage types of the distances
+template class BasicMatrix<double>;
+template class BasicMatrix<float>;
+template class BasicMatrix<int32_t>;
@@ -1,29 +1,83 @@
 #ifndef MATRIX_H_
 #define MATRIX_H_
 
+#include <cstdint>  // int32_t, int64_t
+#include <istream>  // std::istream
 #include <limits>  // std::numeric_limits
+#include <ostream>  // std::ostream
 #include <vector>  // std::vector
 
 const double INF = std::numeric_limits<double>::infinity();
 const int MAX_DIGITS = std::numeric_limits<double>::digits10;
 const double NOT_A_NUMBER = std::numeric_limits<double>::quiet_NaN();
 
-// Symmetric matrix with null diagonal values
-class Matrix {
+// Types of storage of the distances
+enum Storage {
+    DOUBLE_STORAGE,  // Double precision
+    FLOAT_STORAGE,  // Single precision
+    FIXED_STORAGE  // 32-bit integers, scaled by a power of 10
+};
+
+// Symmetric matrix with null diagonal values, stored as values of type T.
+// Values are read and written as double, and stored multiplied by a scale,
+// which is only different from 1 for fixed-point integers
+template <typename T>
+class BasicMatrix {
 public:
-    Matrix();
-    Matrix(const Matrix& other);
-    Matrix(const std::vector<double>& values);
-    Matrix(int nRows);
-    void setValue(int i, int j, double value);
-    double value(int i, int j) const;
+    BasicMatrix();
+    BasicMatrix(const BasicMatrix& other);
+    BasicMatrix(BasicMatrix&& other);
+    BasicMatrix(const std::vector<double>& values);
+    BasicMatrix(std::vector<double>&& values);
+    BasicMatrix(const double* values, int64_t nValues);
+    BasicMatrix(double* values, int64_t nValues, bool inPlace);
+    BasicMatrix(const BasicMatrix<double>& other, double scale);
+    BasicMatrix(int64_t nRows);
+    BasicMatrix& operator=(const BasicMatrix& other);
+    BasicMatrix& operator=(BasicMatrix&& other);
+    void setValue(int64_t i, int64_t j, double value);
+    double value(int64_t i, int64_t j) const;
+    const T* column(int64_t j) const;
+    void compact(const std::vector<int64_t>& rows);
+    double unit() const;
     double minValue() const;
     double maxValue() const;
-    int numRows() const;
-    int precision() const;
+    int64_t numRows() const;
+    int64_t bytes() const;
+    void write(std::ostream& out) const;
+    void read(std::istream& in);
+    int precision(int threads = 1) const;
 private:
-    std::vector<double> values;  // Lower triangular values by columns
-    int index(int i, int j) const;
+    template <typename U> friend class BasicMatrix;
+    int64_t nRows;  // Number of rows
+    int64_t nValues;  // Number of lower triangular values
+    std::vector<T> values;  // Values owned by the matrix, if any
+    T* data;  // Lower triangular values by columns
+    std::vector<int64_t> offsets;  // Offsets of the columns in data
+    double scale;  // Factor of the stored values
+    double unitValue;  // Value of a stored unit, 1 / scale
+    static int decimals(double value);
+    T encode(double value) const;
+    void initRows();
+    void initOffsets();
+    int64_t index(int64_t i, int64_t j) const;
 };
 
+// Values of double matrices are taken over, or used in place, without copies
+template <> BasicMatrix<double>::BasicMatrix(std::vector<double>&& values);
+template <> BasicMatrix<double>::BasicMatrix(double* values, int64_t nValues,
+		bool inPlace);
+
+typedef BasicMatrix<double> Matrix;
+typedef BasicMatrix<float> FloatMatrix;
+typedef BasicMatrix<int32_t> FixedMatrix;
+
+// Precisions of the distances, where negative ones are detected and all of
+// them are limited to the maximum of dist. The largest one is returned
+int effectivePrecisions(const Matrix& dist, std::vector<int>& digits,
+		int threads = 1);
+
+double fixedScale(const Matrix& dist, int precision);
+double floatScale(const Matrix& dist, int precision);
+
 #endif /* MATRIX_H_ */
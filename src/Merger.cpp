@@ -1,22 +1,27 @@
 #include "Merger.h"
 
-#include <list>  // std::list
+#include <cstdint>  // int64_t
 #include <utility>  // std::pair
+#include <vector>  // std::vector
 
 Merger::Merger() {}
 
-std::list< std::pair<int, double> > Merger::getOTUs() const {
+Merger::Merger(int64_t capacity) {
+	this->otus.reserve(capacity);
+}
+
+const std::vector< std::pair<int64_t, double> >& Merger::getOTUs() const {
 	return this->otus;
 }
 
-void Merger::pushBackOTU(int i, double length) {
-	std::pair<int, double> otu(i, length);
+void Merger::pushBackOTU(int64_t i, double length) {
+	std::pair<int64_t, double> otu(i, length);
 	this->otus.push_back(otu);
 	return;
 }
 
-void Merger::pushFrontOTU(int i, double length) {
-	std::pair<int, double> otu(i, length);
-	this->otus.push_front(otu);
+void Merger::pushFrontOTU(int64_t i, double length) {
+	std::pair<int64_t, double> otu(i, length);
+	this->otus.insert(this->otus.begin(), otu);
 	return;
 }
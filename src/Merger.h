@@ -1,17 +1,20 @@
 #ifndef MERGER_H_
 #define MERGER_H_
 
-#include <list>  // std::list
+#include <cstdint>  // int64_t
 #include <utility>  // std::pair
+#include <vector>  // std::vector
 
 class Merger {
 public:
     Merger();
-    std::list< std::pair<int, double> > getOTUs() const;
-    void pushBackOTU(int i, double length);
-    void pushFrontOTU(int i, double length);
+    Merger(int64_t capacity);
+    const std::vector< std::pair<int64_t, double> >& getOTUs() const;
+    void pushBackOTU(int64_t i, double length);
+    void pushFrontOTU(int64_t i, double length);
 private:
-    std::list< std::pair<int, double> > otus;  // OTUs merged and branch lengths
+    // OTUs merged and branch lengths
+    std::vector< std::pair<int64_t, double> > otus;
 };
 
 #endif /* MERGER_H_ */
@@ -1,22 +1,117 @@
-#include <algorithm>  // std::max, std::min
-#include <cmath>  // std::abs, std::floor, std::log10, std::pow, std::round
-#include <list>  // std::list
-#include <queue>  // std::queue
-#include <sstream>  // std::ostringstream
+#include <algorithm>  // std::max, std::min, std::sort
+#include <chrono>  // std::chrono::duration, std::chrono::steady_clock
+#include <cmath>  // std::abs, std::floor, std::llround, std::log10, std::pow
+#include <cstdint>  // int32_t, int64_t
+#include <cstdio>  // std::snprintf
+#include <cstring>  // std::memcmp, std::memcpy
+#include <istream>  // std::istream
+#include <limits>  // std::numeric_limits
+#include <ostream>  // std::ostream
+#include <stdexcept>  // std::runtime_error
 #include <string>  // std::string
+#include <type_traits>  // std::is_same
+#include <utility>  // std::move, std::pair
 #include <vector>  // std::vector
 
 #include "Matrix.h"
 #include "Merger.h"
 #include "Phylogeny.h"
+#include "Profile.h"
 
-Phylogeny::Cluster::Cluster() {
+static const char STATE_MAGIC[8] = {'M', 'F', 'N', 'J', 'S', 'T', 'A', 'T'};
+static const uint32_t STATE_VERSION = 1;
+static const uint32_t STATE_ENDIANNESS = 0x01020304;
+
+// Header of the state of a reconstruction between rounds. It is followed by
+// the agglomerable OTUs in list order, their sums of distances, the mergers,
+// the distances between the agglomerable OTUs and the labels of the taxa
+class StateHeader {
+public:
+	StateHeader();
+	char magic[8];  // File signature
+	uint32_t version;  // Version of the format
+	uint32_t byteOrder;  // Byte order of the machine that wrote the state
+	int32_t storage;  // Storage of the distances
+	int32_t precision;  // Number of significant decimal digits
+	int32_t incrementalSums;  // Update R_i instead of computing it every round
+	int32_t boundedSearch;  // Skip S_ij that cannot reach the minimum
+	int64_t nTaxa;  // Number of taxa
+	int64_t nOTUs;  // Number of OTUs still to agglomerate
+	int64_t nActive;  // Number of agglomerable OTUs
+	int64_t nRounds;  // Number of rounds of agglomerations
+	int64_t nMergers;  // Number of mergers
+	int64_t nPolytomies;  // Number of polytomies
+	double epsilon;  // Very small number
+	int64_t labelsSize;  // Size of the labels, each one ended by '\0'
+};
+
+StateHeader::StateHeader() {
+	std::memcpy(this->magic, STATE_MAGIC, sizeof(STATE_MAGIC));
+	this->version = STATE_VERSION;
+	this->byteOrder = STATE_ENDIANNESS;
+	this->storage = DOUBLE_STORAGE;
+	this->precision = 0;
+	this->incrementalSums = 0;
+	this->boundedSearch = 0;
+	this->nTaxa = 0;
+	this->nOTUs = 0;
+	this->nActive = 0;
+	this->nRounds = 0;
+	this->nMergers = 0;
+	this->nPolytomies = 0;
+	this->epsilon = 0.0;
+	this->labelsSize = 0;
+}
+
+static StateHeader readStateHeader(std::istream& in) {
+	StateHeader header;
+	in.read((char*)&header, sizeof(StateHeader));
+	std::string error;
+	if (!in || (std::memcmp(header.magic, STATE_MAGIC, sizeof(STATE_MAGIC))
+			!= 0)) {
+		error = "not a state of a reconstruction";
+	} else if (header.version != STATE_VERSION) {
+		error = "unsupported version of state of a reconstruction";
+	} else if (header.byteOrder != STATE_ENDIANNESS) {
+		error = "state of a reconstruction written with another byte order";
+	}
+	if (!error.empty()) {
+		throw std::runtime_error(error);
+	}
+	return header;
+}
+
+Storage stateStorage(std::istream& in) {
+	// The header is read, and the stream is left at its start
+	std::streampos start = in.tellg();
+	StateHeader header = readStateHeader(in);
+	in.seekg(start);
+	return (Storage)header.storage;
+}
+
+template <typename T>
+static Storage storageOf() {
+	Storage storage = DOUBLE_STORAGE;
+	if (std::is_same<T, float>::value) {
+		storage = FLOAT_STORAGE;
+	} else if (std::is_same<T, int32_t>::value) {
+		storage = FIXED_STORAGE;
+	}
+	return storage;
+}
+
+template <typename T>
+BasicPhylogeny<T>::Cluster::Cluster() {
 	this->prevOTU = -1;
 	this->nextOTU = -1;
-	this->sumBranches = +INF;
+	this->sumBranches = MAX_KEY;
+	this->firstNeighbor = 0;
+	this->numNeighbors = 0;
+	this->firstNeighborOf = -1;
 }
 
-Phylogeny::Phylogeny() {
+template <typename T>
+BasicPhylogeny<T>::BasicPhylogeny() {
 	this->nTaxa = 0;
 	this->nOTUs = 0;
 	this->nPolytomies = 0;
@@ -24,235 +119,1141 @@ Phylogeny::Phylogeny() {
 	this->precision = 6;
 	this->pow10precision = 1e6;
 	this->firstOTU = -1;
-	this->sMin = +INF;
+	this->sMin = MAX_KEY;
+	this->incrementalSums = false;
+	this->nThreads = 1;
+	this->boundedSearch = false;
+	this->nRounds = 0;
+	this->profiling = false;
+	this->progress = nullptr;
+}
+
+template <typename T>
+BasicPhylogeny<T>::BasicPhylogeny(const BasicMatrix<T>& dist, int precision)
+		: BasicPhylogeny() {
+	this->dist = dist;
+	init(precision);
+}
+
+template <typename T>
+BasicPhylogeny<T>::BasicPhylogeny(BasicMatrix<T>&& dist, int precision)
+		: BasicPhylogeny() {
+	// Take over the distances, which are modified during the reconstruction
+	this->dist = std::move(dist);
+	init(precision);
 }
 
-Phylogeny::Phylogeny(const Matrix& dist, int precision) {
-	this->nTaxa = dist.numRows();
+template <typename T>
+void BasicPhylogeny<T>::setDistances(BasicMatrix<T>&& dist, int precision) {
+	// Start a new reconstruction, keeping the options and the capacity of the
+	// buffers of the previous one
+	this->dist = std::move(dist);
+	init(precision);
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::init(int precision) {
+	this->nTaxa = this->dist.numRows();
 	this->nOTUs = this->nTaxa;
 	this->nPolytomies = 0;
-	this->dist = Matrix(dist);
-	this->sumBranches = Matrix(this->nTaxa);
-	double maxDist = std::max(std::abs(dist.maxValue()), 1.0);
-	int intDigits = 1 + (int)std::floor(std::log10(maxDist));
-	int maxPrecision = MAX_DIGITS - intDigits - 1;
-	this->epsilon = std::pow(10.0, -(double)(maxPrecision + 1));
+	int maxDigits = maxPrecision();
+	this->epsilon = std::pow(10.0, -(double)(maxDigits + 1));
 	// 0 <= precision <= maxPrecision
-	this->precision = std::max(precision, 0);
-	this->precision = std::min(this->precision, maxPrecision);
-	this->pow10precision = std::pow(10.0, (double)this->precision);
+	setPrecision(std::min(std::max(precision, 0), maxDigits));
 	// Initial partition of OTUs
-	this->clusters = std::vector<Cluster>(this->nTaxa);
-	for (int i = 0; i < this->nTaxa; i ++) {
+	this->clusters.assign(this->nTaxa, Cluster());
+	for (int64_t i = 0; i < this->nTaxa; i ++) {
 	    this->clusters[i].prevOTU = i - 1;
 	    this->clusters[i].nextOTU = i + 1;
-		this->clusters[i].sumBranches = +INF;
 	}
 	this->firstOTU = 0;
-	this->sMin = +INF;
-	this->mergers.reserve(this->nTaxa - 1);
+	this->sMin = MAX_KEY;
+	this->mergers.clear();
+	this->mergers.reserve(std::max(this->nTaxa - 1, (int64_t)0));
+	this->rowSums.assign(this->nTaxa, 0.0);
+	this->rowMins.assign(this->nTaxa, +INF);
+	this->slots.resize(this->nTaxa);
+	for (int64_t i = 0; i < this->nTaxa; i ++) {
+		this->slots[i] = i;
+	}
+	this->nRounds = 0;
+	initBuffers();
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::initBuffers() {
+	// Buffers of the rounds, for nTaxa OTUs
+	this->slotSums.reserve(this->nTaxa);
+	this->profile.clear();
+	this->sortedDists.clear();
+	this->sortedRound.clear();
+	this->activeOTUs.clear();
+	this->activeOTUs.reserve(this->nTaxa);
+	this->newDists.reserve(this->nTaxa);
+	this->withinSums.assign(this->nTaxa, 0.0);
+	this->otusMin.clear();
+	// Arenas reused by every round
+	this->connected.assign(this->nTaxa, false);
+	this->neighbors.clear();
+	this->neighbors.reserve(2 * this->nTaxa);
+	this->edgeOTU.clear();
+	this->edgeOTU.reserve(this->nTaxa);
+	this->edgeNext.clear();
+	this->edgeNext.reserve(this->nTaxa);
+	this->queue.reserve(2 * this->nTaxa);
+	this->subsetIc.reserve(this->nTaxa);
+	this->rowSumsI.assign(this->nTaxa, 0.0);
+	this->rowSumsIc.assign(this->nTaxa, 0.0);
+	return;
 }
 
-void Phylogeny::reconstruct() {
+template <typename T>
+int BasicPhylogeny<T>::maxPrecision() const {
+	// Significant decimal digits left by the integer part of the maximum
+	// distance, which is only known before the first round
+	double maxDist = std::max(std::abs(this->dist.maxValue()), 1.0);
+	int intDigits = 1 + (int)std::floor(std::log10(maxDist));
+	return MAX_DIGITS - intDigits - 1;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::setPrecision(int precision) {
+	this->precision = precision;
+	this->pow10precision = std::pow(10.0, (double)this->precision);
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::startLap() {
+	if (this->profiling) {
+		this->lapStart = std::chrono::steady_clock::now();
+	}
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::lap(double& seconds) {
+	// Seconds since the last lap are added, and a new lap starts
+	if (this->profiling) {
+		std::chrono::steady_clock::time_point now =
+				std::chrono::steady_clock::now();
+		seconds += std::chrono::duration<double>(now - this->lapStart).count();
+		this->lapStart = now;
+	}
+	return;
+}
+
+template <typename T>
+int64_t BasicPhylogeny<T>::bytes() const {
+	// Capacity of the distances, the buffers and the arenas of the engine
+	int64_t nBytes = this->dist.bytes();
+	nBytes += sizeof(int64_t) * (this->slots.capacity()
+			+ this->sortedRound.capacity() + this->activeOTUs.capacity()
+			+ this->otusMin.capacity() + this->neighbors.capacity()
+			+ this->edgeOTU.capacity() + this->edgeNext.capacity()
+			+ this->queue.capacity() + this->subsetIc.capacity());
+	nBytes += sizeof(double) * (this->slotSums.capacity()
+			+ this->rowSums.capacity() + this->rowMins.capacity()
+			+ this->newDists.capacity()
+			+ this->withinSums.capacity() + this->rowSumsI.capacity()
+			+ this->rowSumsIc.capacity());
+	nBytes += this->connected.capacity() / 8;
+	nBytes += sizeof(Cluster) * this->clusters.capacity();
+	nBytes += sizeof(std::vector<Neighbor>) * this->sortedDists.capacity();
+	for (std::size_t i = 0; i < this->sortedDists.size(); i ++) {
+		nBytes += sizeof(Neighbor) * this->sortedDists[i].capacity();
+	}
+	nBytes += sizeof(Merger) * this->mergers.capacity();
+	for (std::size_t m = 0; m < this->mergers.size(); m ++) {
+		nBytes += sizeof(std::pair<int64_t, double>)
+				* this->mergers[m].getOTUs().capacity();
+	}
+	nBytes += sizeof(RoundProfile) * this->profile.capacity();
+	return nBytes;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::setIncrementalSums(bool incremental) {
+	this->incrementalSums = incremental;
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::setThreads(int threads) {
+	this->nThreads = std::max(threads, 1);
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::setBoundedSearch(bool bounded) {
+	this->boundedSearch = bounded;
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::setProfiling(bool profiling) {
+	this->profiling = profiling;
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::setProgress(Progress* progress) {
+	// The observer is not owned, and must outlive the reconstruction
+	this->progress = progress;
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::reconstruct() {
+	// Initial sorting of the bounded search is profiled as part of its first
+	// search of the minimum
+	double sorting = 0.0;
+	startLap();
+	if (this->boundedSearch) {
+		sortDistances(true);
+	}
+	lap(sorting);
 	// Repeat while there are OTUs to agglomerate
 	while (this->nOTUs > 1) {
-		sumBranchLengths();
-		minimizeSumBranches();
-		connectComponents();
-		agglomerateOTUs();
-		updateDistances();
-		clearNearestNeighbors();
+		RoundProfile round;
+		round.minimize = sorting;
+		sorting = 0.0;
+		startRound(round);
+		if (this->boundedSearch) {
+			minimizeBoundedSumBranches();
+		} else {
+			minimizeSumBranches();
+		}
+		lap(round.minimize);
+		finishRound(round);
+		if ((this->progress != nullptr) &&
+				!this->progress->update(this->nRounds, this->nOTUs)) {
+			break;
+		}
 	}
 	return;
 }
 
-int Phylogeny::numPolytomies() const {
+template <typename T>
+std::vector< BasicPhylogeny<T> > BasicPhylogeny<T>::sweep(
+		const std::vector<int>& precisions) {
+	// Trees of every precision, in the same order, from the distances of this
+	// engine, which is left without them. A group of precisions shares an
+	// engine while the pairs tied at the minimum agree at all of them, and it
+	// forks a copy of the engine for every other set of tied pairs. Row sums
+	// and, in the exhaustive search, the minima of the rows are computed once
+	// per group, since only their quantization depends on the precision
+	std::vector<BasicPhylogeny> trees(precisions.size());
+	if (precisions.empty()) {
+		return trees;
+	}
+	int maxDigits = maxPrecision();
+	std::vector<int> digits(precisions.size());
+	std::vector<std::size_t> all(precisions.size());
+	for (std::size_t p = 0; p < precisions.size(); p ++) {
+		digits[p] = std::min(std::max(precisions[p], 0), maxDigits);
+		all[p] = p;
+	}
+	std::vector<BasicPhylogeny> engines;
+	std::vector< std::vector<std::size_t> > groups;
+	engines.push_back(std::move(*this));
+	groups.push_back(all);
+	double sorting = 0.0;
+	engines[0].startLap();
+	if (engines[0].boundedSearch) {
+		engines[0].sortDistances(true);
+	}
+	engines[0].lap(sorting);
+	std::vector< std::vector< std::pair<int64_t, int64_t> > > ties(
+			precisions.size());
+	bool unfinished = (engines[0].nOTUs > 1);
+	while (unfinished) {
+		// A round of every group, in lockstep
+		std::vector<BasicPhylogeny> forks;
+		std::vector< std::vector<std::size_t> > forkGroups;
+		int64_t nRounds = 0;
+		int64_t nOTUs = 0;
+		for (std::size_t g = 0; g < engines.size(); g ++) {
+			BasicPhylogeny& engine = engines[g];
+			if (engine.nOTUs <= 1) {
+				continue;
+			}
+			const std::vector<std::size_t>& group = groups[g];
+			RoundProfile round;
+			round.minimize = sorting;
+			sorting = 0.0;
+			engine.startRound(round);
+			if (!engine.boundedSearch) {
+				engine.minimizeRows();
+			}
+			for (std::size_t m = 0; m < group.size(); m ++) {
+				engine.setPrecision(digits[group[m]]);
+				if (engine.boundedSearch) {
+					engine.minimizeBoundedSumBranches();
+				} else {
+					engine.selectMinimum();
+				}
+				engine.tiedPairs(ties[group[m]]);
+			}
+			engine.lap(round.minimize);
+			// The engine goes on with the ties of the last precision, whose
+			// minimum it holds, and the other ties fork
+			const std::vector< std::pair<int64_t, int64_t> >& kept =
+					ties[group.back()];
+			std::vector<std::size_t> same;
+			std::vector<std::size_t> other;
+			for (std::size_t m = 0; m < group.size(); m ++) {
+				if (ties[group[m]] == kept) {
+					same.push_back(group[m]);
+				} else {
+					other.push_back(group[m]);
+				}
+			}
+			while (!other.empty()) {
+				std::vector<std::size_t> forked;
+				std::vector<std::size_t> rest;
+				for (std::size_t m = 0; m < other.size(); m ++) {
+					if (ties[other[m]] == ties[other.front()]) {
+						forked.push_back(other[m]);
+					} else {
+						rest.push_back(other[m]);
+					}
+				}
+				BasicPhylogeny fork(engine);
+				fork.setPrecision(digits[forked.front()]);
+				if (fork.boundedSearch) {
+					fork.minimizeBoundedSumBranches();
+				} else {
+					fork.selectMinimum();
+				}
+				RoundProfile forkRound = round;
+				fork.finishRound(forkRound);
+				forks.push_back(std::move(fork));
+				forkGroups.push_back(forked);
+				other.swap(rest);
+			}
+			engine.finishRound(round);
+			groups[g] = same;
+			nRounds = std::max(nRounds, engine.nRounds);
+			nOTUs = std::max(nOTUs, engine.nOTUs);
+		}
+		for (std::size_t f = 0; f < forks.size(); f ++) {
+			nOTUs = std::max(nOTUs, forks[f].nOTUs);
+			engines.push_back(std::move(forks[f]));
+			groups.push_back(forkGroups[f]);
+		}
+		unfinished = (nOTUs > 1);
+		Progress* progress = engines[0].progress;
+		if (unfinished && (progress != nullptr)
+				&& !progress->update(nRounds, nOTUs)) {
+			break;
+		}
+	}
+	// Finished trees no longer need their distances, but keep a row for
+	// every agglomerable OTU as states do. The precisions of a group share
+	// its mergers
+	for (std::size_t g = 0; g < engines.size(); g ++) {
+		if (engines[g].isFinished()) {
+			engines[g].listOTUs();
+			engines[g].compactDistances();
+			engines[g].dist = BasicMatrix<T>(engines[g].dist.numRows());
+		}
+		const std::vector<std::size_t>& group = groups[g];
+		for (std::size_t m = 0; m + 1 < group.size(); m ++) {
+			trees[group[m]] = engines[g];
+			trees[group[m]].setPrecision(digits[group[m]]);
+		}
+		trees[group.back()] = std::move(engines[g]);
+		trees[group.back()].setPrecision(digits[group.back()]);
+	}
+	return trees;
+}
+
+template <typename T>
+int BasicPhylogeny<T>::getPrecision() const {
+	return this->precision;
+}
+
+template <typename T>
+Storage BasicPhylogeny<T>::getStorage() const {
+	return storageOf<T>();
+}
+
+template <typename T>
+int BasicPhylogeny<T>::numPolytomies() const {
 	return this->nPolytomies;
 }
 
-std::vector<Merger> Phylogeny::getMergers() const {
+template <typename T>
+const std::vector<Merger>& BasicPhylogeny<T>::getMergers() const {
 	return this->mergers;
 }
 
-std::string Phylogeny::getNewick(const std::vector<std::string>& labels) const {
-	std::vector<std::string> newick = labels;
-	std::ostringstream oss;
-	oss.setf(std::ios::fixed, std::ios::floatfield);  // Fixed precision
-	oss.precision(std::max(this->precision, 0));  // Modify default precision
-	for (int i = 0; i < (int)this->mergers.size(); i ++) {
-		std::list< std::pair<int, double> > otus = this->mergers[i].getOTUs();
-		std::list< std::pair<int, double> >::const_iterator it = otus.begin();
-		std::pair<int, double> otu = *it;
-		int j = otu.first;
-		int jmin = j;
-		double length = otu.second;
-		oss.str("");  // clear oss
-		oss << "(" << newick[j] << ":" << length;
-		it ++;
-		while (it != otus.end()) {
-			otu = *it;
-			j = otu.first;
-			length = otu.second;
-			oss << "," << newick[j] << ":" << length;
-			it ++;
-		}
-		oss << ")";
-		newick[jmin] = oss.str();
-	}
-	newick[0] += ";";
-	return newick[0];
-}
-
-void Phylogeny::sumBranchLengths() {
-	// R_i = sum_k D_ik
-    std::vector<double> r = std::vector<double>(this->nTaxa, 0.0);
-	int i = this->firstOTU;
-	while (i < this->nTaxa) {
-		int k = this->firstOTU;
-		while (k < this->nTaxa) {
-			if (k != i) {
-				double dik = this->dist.value(i, k);
-				r[i] += dik;
+template <typename T>
+const std::vector<RoundProfile>& BasicPhylogeny<T>::getProfile() const {
+	return this->profile;
+}
+
+template <typename T>
+std::string BasicPhylogeny<T>::getNewick(
+		const std::vector<std::string>& labels) const {
+	std::vector<int64_t> firstChild;
+	std::vector<int64_t> children;
+	int64_t root = mergerTree(firstChild, children);
+	int precision = std::max(this->precision, 0);
+	std::size_t nChars = 1;
+	for (int64_t i = 0; i < this->nTaxa; i ++) {
+		nChars += labels[i].size();
+	}
+	nChars += 2 * this->mergers.size() + children.size() * (precision + 8);
+	// Depth-first search into a single string, where every frame of the stack
+	// is a node and the number of its children already written
+	std::string newick;
+	newick.reserve(nChars);
+	char length[512];  // Enough for any double in fixed notation
+	std::vector< std::pair<int64_t, int64_t> > stack;
+	if (root > -1) {
+		stack.push_back(std::make_pair(root, (int64_t)0));
+	}
+	while (!stack.empty()) {
+		int64_t v = stack.back().first;
+		int64_t c = stack.back().second;
+		if (v < this->nTaxa) {  // taxon
+			newick += labels[v];
+			stack.pop_back();
+		} else {  // merger
+			int64_t m = v - this->nTaxa;
+			const std::vector< std::pair<int64_t, double> >& otus =
+					this->mergers[m].getOTUs();
+			if (c > 0) {  // branch length of the child just written
+				std::snprintf(length, sizeof(length), ":%.*f", precision,
+						otus[c - 1].second);
+				newick += length;
+			}
+			if (c == (int64_t)otus.size()) {
+				newick += ")";
+				stack.pop_back();
+			} else {
+				newick += (c == 0)? "(" : ",";
+				stack.back().second ++;
+				stack.push_back(std::make_pair(children[firstChild[m] + c],
+						(int64_t)0));
 			}
-			k = this->clusters[k].nextOTU;
 		}
-		i = this->clusters[i].nextOTU;
 	}
-	// S_ij = (N - 2) D_ij - R_i - R_j
-	i = this->firstOTU;
-	while (i < this->nTaxa) {
-		int j = this->clusters[i].nextOTU;
-		while (j < this->nTaxa) {
-			double dij = this->dist.value(i, j);
-			double sij = (this->nOTUs - 2) * dij - r[i] - r[j];
-			this->sumBranches.setValue(i, j, sij);
-			j = this->clusters[j].nextOTU;
+	newick += ";";
+	return newick;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::getEdges(std::vector<int64_t>& parents,
+		std::vector<int64_t>& children, std::vector<double>& lengths) const {
+	// Edges in preorder, as in ape "cladewise" order. Taxa are nodes 0 to
+	// nTaxa - 1, and mergers are numbered from nTaxa in preorder, so that
+	// nTaxa is the root
+	std::vector<int64_t> firstChild;
+	std::vector<int64_t> childNodes;
+	int64_t root = mergerTree(firstChild, childNodes);
+	parents.clear();
+	children.clear();
+	lengths.clear();
+	parents.reserve(childNodes.size());
+	children.reserve(childNodes.size());
+	lengths.reserve(childNodes.size());
+	std::vector<int64_t> number(this->mergers.size());
+	int64_t nNumbered = this->nTaxa;
+	// Every frame of the stack is a merger and the number of its children
+	// already visited
+	std::vector< std::pair<int64_t, int64_t> > stack;
+	if (root >= this->nTaxa) {
+		number[root - this->nTaxa] = nNumbered;
+		nNumbered ++;
+		stack.push_back(std::make_pair(root, (int64_t)0));
+	}
+	while (!stack.empty()) {
+		int64_t m = stack.back().first - this->nTaxa;
+		int64_t c = stack.back().second;
+		const std::vector< std::pair<int64_t, double> >& otus =
+				this->mergers[m].getOTUs();
+		if (c == (int64_t)otus.size()) {
+			stack.pop_back();
+		} else {
+			stack.back().second ++;
+			int64_t v = childNodes[firstChild[m] + c];
+			parents.push_back(number[m]);
+			lengths.push_back(otus[c].second);
+			if (v < this->nTaxa) {  // taxon
+				children.push_back(v);
+			} else {  // merger
+				number[v - this->nTaxa] = nNumbered;
+				children.push_back(nNumbered);
+				nNumbered ++;
+				stack.push_back(std::make_pair(v, (int64_t)0));
+			}
 		}
-		i = this->clusters[i].nextOTU;
 	}
 	return;
 }
 
-void Phylogeny::minimizeSumBranches() {
-	// Get the minimum sum of branch lengths and the corresponding list of OTUs
-	this->sMin = +INF;
-	int i = this->firstOTU;
+template <typename T>
+bool BasicPhylogeny<T>::isFinished() const {
+	return this->nOTUs <= 1;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::writeState(std::ostream& out,
+		const std::vector<std::string>& labels) {
+	// State between rounds, where only the distances between agglomerable
+	// OTUs are written, once compacted into the first rows
+	listOTUs();
+	int64_t nActive = this->activeOTUs.size();
+	if (this->dist.numRows() > nActive) {
+		compactDistances();
+	}
+	if ((int64_t)labels.size() != this->nTaxa) {
+		throw std::runtime_error("number of labels and taxa do not match");
+	}
+	StateHeader header;
+	header.storage = storageOf<T>();
+	header.precision = this->precision;
+	header.incrementalSums = this->incrementalSums? 1 : 0;
+	header.boundedSearch = this->boundedSearch? 1 : 0;
+	header.nTaxa = this->nTaxa;
+	header.nOTUs = this->nOTUs;
+	header.nActive = nActive;
+	header.nRounds = this->nRounds;
+	header.nMergers = this->mergers.size();
+	header.nPolytomies = this->nPolytomies;
+	header.epsilon = this->epsilon;
+	for (std::size_t i = 0; i < labels.size(); i ++) {
+		header.labelsSize += labels[i].size() + 1;
+	}
+	out.write((const char*)&header, sizeof(StateHeader));
+	out.write((const char*)this->activeOTUs.data(), nActive * sizeof(int64_t));
+	for (int64_t a = 0; a < nActive; a ++) {
+		double ri = this->rowSums[this->activeOTUs[a]];
+		out.write((const char*)&ri, sizeof(double));
+	}
+	for (std::size_t m = 0; m < this->mergers.size(); m ++) {
+		const std::vector< std::pair<int64_t, double> >& otus =
+				this->mergers[m].getOTUs();
+		int64_t nMerged = otus.size();
+		out.write((const char*)&nMerged, sizeof(int64_t));
+		for (int64_t c = 0; c < nMerged; c ++) {
+			out.write((const char*)&otus[c].first, sizeof(int64_t));
+			out.write((const char*)&otus[c].second, sizeof(double));
+		}
+	}
+	this->dist.write(out);
+	for (std::size_t i = 0; i < labels.size(); i ++) {
+		out.write(labels[i].c_str(), labels[i].size() + 1);
+	}
+	if (!out) {
+		throw std::runtime_error("cannot write the state of the reconstruction");
+	}
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::readState(std::istream& in,
+		std::vector<std::string>& labels) {
+	// Resume a reconstruction from a state written by writeState(), keeping
+	// the number of threads, the profiling and the observer
+	StateHeader header = readStateHeader(in);
+	const char* corrupted = "corrupted state of a reconstruction";
+	if (header.storage != storageOf<T>()) {
+		throw std::runtime_error("state of a reconstruction with another "
+				"storage of the distances");
+	}
+	if ((header.nTaxa < 0) || (header.nActive < 0)
+			|| (header.nActive > header.nTaxa) || (header.nOTUs < 0)
+			|| (header.nOTUs > header.nTaxa) || (header.nMergers < 0)
+			|| (header.nMergers >= std::max(header.nTaxa, (int64_t)1))
+			|| (header.labelsSize < header.nTaxa)) {
+		throw std::runtime_error(corrupted);
+	}
+	this->nTaxa = header.nTaxa;
+	this->nOTUs = header.nOTUs;
+	this->nPolytomies = (int)header.nPolytomies;
+	setPrecision(header.precision);
+	this->epsilon = header.epsilon;
+	this->incrementalSums = (header.incrementalSums != 0);
+	this->boundedSearch = (header.boundedSearch != 0);
+	this->nRounds = header.nRounds;
+	this->sMin = MAX_KEY;
+	// Agglomerable OTUs, whose rows in dist are in list order
+	std::vector<int64_t> active(header.nActive);
+	std::vector<double> sums(header.nActive);
+	in.read((char*)active.data(), header.nActive * sizeof(int64_t));
+	in.read((char*)sums.data(), header.nActive * sizeof(double));
+	for (int64_t a = 0; a < header.nActive; a ++) {
+		if ((active[a] < 0) || (active[a] >= this->nTaxa)
+				|| ((a > 0) && (active[a] <= active[a - 1]))) {
+			throw std::runtime_error(corrupted);
+		}
+	}
+	this->clusters.assign(this->nTaxa, Cluster());
+	this->slots.assign(this->nTaxa, 0);
+	this->rowSums.assign(this->nTaxa, 0.0);
+	this->rowMins.assign(this->nTaxa, +INF);
+	for (int64_t a = 0; a < header.nActive; a ++) {
+		int64_t i = active[a];
+		this->clusters[i].prevOTU = (a > 0)? active[a - 1] : -1;
+		this->clusters[i].nextOTU = (a + 1 < header.nActive)? active[a + 1]
+				: this->nTaxa;
+		this->slots[i] = a;
+		this->rowSums[i] = sums[a];
+	}
+	this->firstOTU = (header.nActive > 0)? active[0] : this->nTaxa;
+	// History of mergers
+	this->mergers.clear();
+	this->mergers.reserve(std::max(this->nTaxa - 1, (int64_t)0));
+	for (int64_t m = 0; m < header.nMergers; m ++) {
+		int64_t nMerged = 0;
+		in.read((char*)&nMerged, sizeof(int64_t));
+		if (!in || (nMerged < 2) || (nMerged > this->nTaxa)) {
+			throw std::runtime_error(corrupted);
+		}
+		Merger merger(nMerged);
+		for (int64_t c = 0; c < nMerged; c ++) {
+			int64_t i = -1;
+			double length = 0.0;
+			in.read((char*)&i, sizeof(int64_t));
+			in.read((char*)&length, sizeof(double));
+			if (!in || (i < 0) || (i >= this->nTaxa)) {
+				throw std::runtime_error(corrupted);
+			}
+			merger.pushBackOTU(i, length);
+		}
+		this->mergers.push_back(std::move(merger));
+	}
+	this->dist.read(in);
+	if (this->dist.numRows() != header.nActive) {
+		throw std::runtime_error(corrupted);
+	}
+	// Labels of the taxa, each one ended by '\0'
+	std::string text(header.labelsSize, '\0');
+	in.read(&text[0], header.labelsSize);
+	if (!in) {
+		throw std::runtime_error(corrupted);
+	}
+	labels.clear();
+	labels.reserve(this->nTaxa);
+	std::size_t start = 0;
+	while ((start < text.size()) && ((int64_t)labels.size() < this->nTaxa)) {
+		std::size_t end = text.find('\0', start);
+		if (end == std::string::npos) {
+			end = text.size();
+		}
+		labels.push_back(text.substr(start, end - start));
+		start = end + 1;
+	}
+	if ((int64_t)labels.size() != this->nTaxa) {
+		throw std::runtime_error(corrupted);
+	}
+	initBuffers();
+	return;
+}
+
+template <typename T>
+int64_t BasicPhylogeny<T>::mergerTree(std::vector<int64_t>& firstChild,
+		std::vector<int64_t>& children) const {
+	// Tree of mergers, whose nodes are the taxa followed by the mergers. The
+	// children of merger m are children[firstChild[m]] to
+	// children[firstChild[m + 1] - 1], and the root is returned. The root is
+	// the last merger, which is not the node of taxon 0 when the last OTU
+	// left is pushed to its front
+	int64_t nMergers = this->mergers.size();
+	std::vector<int64_t> node(this->nTaxa);  // Last node of every OTU
+	firstChild.assign(nMergers + 1, 0);
+	children.clear();
+	children.reserve(this->nTaxa + nMergers);
+	for (int64_t i = 0; i < this->nTaxa; i ++) {
+		node[i] = i;
+	}
+	for (int64_t m = 0; m < nMergers; m ++) {
+		const std::vector< std::pair<int64_t, double> >& otus =
+				this->mergers[m].getOTUs();
+		firstChild[m] = children.size();
+		for (std::size_t c = 0; c < otus.size(); c ++) {
+			children.push_back(node[otus[c].first]);
+		}
+		node[otus.front().first] = this->nTaxa + m;
+	}
+	firstChild[nMergers] = children.size();
+	int64_t root = -1;
+	if (nMergers > 0) {
+		root = this->nTaxa + nMergers - 1;
+	} else if (this->nTaxa > 0) {
+		root = node[0];
+	}
+	return root;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::listOTUs() {
+	// Work of every round is partitioned over the agglomerable OTUs
+	this->activeOTUs.clear();
+	int64_t i = this->firstOTU;
 	while (i < this->nTaxa) {
-		// Get the minimum sum of branch lengths TO THE RIGHT of i
+		this->activeOTUs.push_back(i);
+		i = this->clusters[i].nextOTU;
+	}
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::compactDistances() {
+	// Agglomerable OTUs, in list order, become the first rows of dist
+	int64_t nActive = this->activeOTUs.size();
+	std::vector<int64_t> rows(nActive);
+	for (int64_t a = 0; a < nActive; a ++) {
+		int64_t i = this->activeOTUs[a];
+		rows[a] = this->slots[i];
+		this->slots[i] = a;
+	}
+	this->dist.compact(rows);
+	return;
+}
+
+template <typename T>
+double BasicPhylogeny<T>::distance(int64_t i, int64_t j) const {
+	return this->dist.value(this->slots[i], this->slots[j]);
+}
+
+template <typename T>
+void BasicPhylogeny<T>::setDistance(int64_t i, int64_t j, double value) {
+	this->dist.setValue(this->slots[i], this->slots[j], value);
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::startRound(RoundProfile& round) {
+	// Agglomerable OTUs and their sums of distances, which do not depend on
+	// the precision
+	this->nRounds ++;
+	round.round = this->nRounds;
+	round.nOTUs = this->nOTUs;
+	startLap();
+	listOTUs();
+	// Once half of the rows are no longer used, the remaining ones are
+	// compacted, so that the scans of every row stay dense
+	if (2 * (int64_t)this->activeOTUs.size() <= this->dist.numRows()) {
+		compactDistances();
+	}
+	// Incremental sums are only computed from scratch in the first round
+	if (!this->incrementalSums || (this->nOTUs == this->nTaxa)) {
+		sumRows();
+	}
+	lap(round.sums);
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::finishRound(RoundProfile& round) {
+	// Agglomerate the OTUs at the minimum sum of branch lengths
+	connectComponents();
+	lap(round.connect);
+	int64_t firstMerger = this->mergers.size();
+	agglomerateOTUs();
+	lap(round.agglomerate);
+	updateDistances();
+	if (this->boundedSearch) {
+		sortDistances(false);
+	}
+	lap(round.update);
+	if (this->profiling) {
+		// Every edge to a nearest neighbor is a pair tied at the minimum
+		round.nTies = this->edgeOTU.size();
+		round.nMergers = this->mergers.size() - firstMerger;
+		for (std::size_t m = firstMerger; m < this->mergers.size(); m ++) {
+			round.maxMerged = std::max(round.maxMerged,
+					(int64_t)this->mergers[m].getOTUs().size());
+		}
+		round.bytes = bytes();
+		this->profile.push_back(round);
+	}
+	clearNearestNeighbors();
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::sumRows() {
+	// R_i = sum_k D_ik
+	int64_t nActive = this->activeOTUs.size();
+#ifdef _OPENMP
+	#pragma omp parallel for num_threads(this->nThreads) \
+			if (this->nThreads > 1) schedule(static)
+#endif
+	for (int64_t a = 0; a < nActive; a ++) {
+		int64_t i = this->activeOTUs[a];
+		double ri = 0.0;
+		for (int64_t b = 0; b < nActive; b ++) {
+			int64_t k = this->activeOTUs[b];
+			if (k != i) {
+				double dik = distance(i, k);
+				ri += dik;
+			}
+		}
+		this->rowSums[i] = ri;
+	}
+	return;
+}
+
+template <typename T>
+double BasicPhylogeny<T>::sumBranchLengths(int64_t i, int64_t j) const {
+	// S_ij = (N - 2) D_ij - R_i - R_j
+	double dij = distance(i, j);
+	return (this->nOTUs - 2) * dij - this->rowSums[i] - this->rowSums[j];
+}
+
+template <typename T>
+void BasicPhylogeny<T>::minimizeSumBranches() {
+	// Get the minimum sum of branch lengths TO THE RIGHT of every OTU. Rounding
+	// is monotonic, so only the minimum S_ij of every row has to be quantized
+	minimizeRows();
+	selectMinimum();
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::minimizeRows() {
+	// Minimum S_ij TO THE RIGHT of every OTU, before rounding
+	int64_t nActive = this->activeOTUs.size();
+	int64_t nRows = this->dist.numRows();
+	double nm2 = (double)(this->nOTUs - 2);
+	double unit = this->dist.unit();
+	// Rows no longer used get S_ij = +INF, so that every row is swept without
+	// looking up the agglomerable OTUs
+	this->slotSums.assign(nRows, -INF);
+	for (int64_t a = 0; a < nActive; a ++) {
+		int64_t i = this->activeOTUs[a];
+		this->slotSums[this->slots[i]] = this->rowSums[i];
+	}
+#ifdef _OPENMP
+	#pragma omp parallel for num_threads(this->nThreads) \
+			if (this->nThreads > 1) schedule(dynamic, 16)
+#endif
+	for (int64_t a = 0; a < nActive; a ++) {
+		int64_t i = this->activeOTUs[a];
+		// D_ij TO THE RIGHT of i are contiguous, so the loop can be vectorized
+		int64_t si = this->slots[i];
+		const T* di = this->dist.column(si);
+		double ri = this->rowSums[i];
 		double siMin = +INF;
-		int jmin = -1;
-		int j = this->clusters[i].nextOTU;
-		while (j < this->nTaxa) {
-		    double sij = precisionRound(this->sumBranches.value(i, j));
-		    if (sij < siMin) {
-		    	siMin = sij;
-		    	jmin = j;
-		    }
-		    j = this->clusters[j].nextOTU;
-		}
-		this->clusters[i].sumBranches = siMin;
-		if (jmin > -1) {
-			// Add the first nearest neighbor TO THE RIGHT of i
-			this->clusters[i].nearestNeighbors = {jmin};
-			this->clusters[jmin].nearestNeighborOf.push_back(i);
+		for (int64_t s = si + 1; s < nRows; s ++) {
+			double sij = nm2 * (di[s] * unit) - ri - this->slotSums[s];
+			siMin = (sij < siMin)? sij : siMin;
 		}
+		this->rowMins[i] = siMin;
+	}
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::selectMinimum() {
+	// Quantize the minima of the rows, and merge them in list order
+	int64_t nActive = this->activeOTUs.size();
+	for (int64_t a = 0; a < nActive; a ++) {
+		int64_t i = this->activeOTUs[a];
+		this->clusters[i].sumBranches = quantize(this->rowMins[i]);
+	}
+	this->sMin = MAX_KEY;
+	for (int64_t a = 0; a < nActive; a ++) {
+		int64_t i = this->activeOTUs[a];
+		int64_t siMin = this->clusters[i].sumBranches;
 		if (siMin < this->sMin) {
 			this->sMin = siMin;
 			this->otusMin.clear();
 			this->otusMin = {i};
 		} else if (siMin == this->sMin) {
 			this->otusMin.push_back(i);
-    	}
-		i = this->clusters[i].nextOTU;
+		}
 	}
 	return;
 }
 
-void Phylogeny::connectComponents() {
-	// Complete nearest neighbors of minimum OTUs
-	std::list<int>::iterator itmin = this->otusMin.begin();
-	while (itmin != this->otusMin.end()) {
-		int i = *itmin;
-		// Include additional nearest neighbors TO THE RIGHT of i
-		int j = this->clusters[i].nearestNeighbors.front();
-		j = this->clusters[j].nextOTU;
+template <typename T>
+void BasicPhylogeny<T>::sortDistances(bool all) {
+	// At the start, every OTU sorts its distances TO THE RIGHT. Later on, only
+	// the new clusters sort their distances to all remaining OTUs
+	std::vector<int64_t> sorting;
+	if (all) {
+		this->sortedDists = std::vector< std::vector<Neighbor> >(this->nTaxa);
+		this->sortedRound = std::vector<int64_t>(this->nTaxa, this->nRounds);
+		int64_t i = this->firstOTU;
+		while (i < this->nTaxa) {
+			sorting.push_back(i);
+			i = this->clusters[i].nextOTU;
+		}
+	} else {
+		sorting.assign(this->otusMin.begin(), this->otusMin.end());
+	}
+	int64_t nSorting = sorting.size();
+#ifdef _OPENMP
+	#pragma omp parallel for num_threads(this->nThreads) \
+			if (this->nThreads > 1) schedule(dynamic, 16)
+#endif
+	for (int64_t a = 0; a < nSorting; a ++) {
+		int64_t i = sorting[a];
+		std::vector<Neighbor>& row = this->sortedDists[i];
+		row.clear();
+		int64_t k = all? this->clusters[i].nextOTU : this->firstOTU;
+		while (k < this->nTaxa) {
+			if (k != i) {
+				// Stored values sort as the distances they represent
+				int64_t s1 = std::min(this->slots[i], this->slots[k]);
+				int64_t s2 = std::max(this->slots[i], this->slots[k]);
+				row.push_back(Neighbor(this->dist.column(s1)[s2], (int32_t)k));
+			}
+			k = this->clusters[k].nextOTU;
+		}
+		std::sort(row.begin(), row.end());
+		this->sortedRound[i] = this->nRounds;
+	}
+	return;
+}
+
+template <typename T>
+bool BasicPhylogeny<T>::isSortedNeighbor(int64_t i, int64_t j) const {
+	// D_ij is up to date in the sorted distances of the last OTU updated
+	bool sorted;
+	if (this->clusters[j].nextOTU < 0) {  // j already agglomerated
+		sorted = false;
+	} else if (this->sortedRound[j] == this->sortedRound[i]) {
+		sorted = (j > i);
+	} else {
+		sorted = (this->sortedRound[j] < this->sortedRound[i]);
+	}
+	return sorted;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::minimizeBoundedSumBranches() {
+	// Get the minimum sum of branch lengths as in RapidNJ: distances of every
+	// OTU are sorted, so S_ij >= (N - 2) D_ij - R_i - max_k R_k bounds the
+	// rest of the row, which is skipped once the bound exceeds the minimum
+	int64_t nActive = this->activeOTUs.size();
+	double maxR = -INF;
+	for (int64_t a = 0; a < nActive; a ++) {
+		maxR = std::max(maxR, this->rowSums[this->activeOTUs[a]]);
+	}
+	double nm2 = (double)(this->nOTUs - 2);
+	double unit = 1.0 / this->pow10precision;
+	double distUnit = this->dist.unit();
+	double tolerance = 16.0 * std::numeric_limits<double>::epsilon();
+	// Pairs of OTUs tied at the minimum sum of branch lengths
+	std::vector< std::pair<int64_t, int64_t> > pairsMin;
+	this->sMin = MAX_KEY;
+#ifdef _OPENMP
+	#pragma omp parallel num_threads(this->nThreads) if (this->nThreads > 1)
+#endif
+	{
+		int64_t sThread = MAX_KEY;
+		double sBound = +INF;
+		std::vector< std::pair<int64_t, int64_t> > pairsThread;
+#ifdef _OPENMP
+		#pragma omp for schedule(dynamic, 16)
+#endif
+		for (int64_t a = 0; a < nActive; a ++) {
+			int64_t i = this->activeOTUs[a];
+			std::vector<Neighbor>& row = this->sortedDists[i];
+			double ri = this->rowSums[i];
+			std::size_t nOutdated = 0;
+			for (std::size_t b = 0; b < row.size(); b ++) {
+				double dij = row[b].first * distUnit;
+				int64_t j = row[b].second;
+				// Rounding errors and half a unit of precision are tolerated,
+				// so that no pair tied at the minimum is ever skipped
+				double lower = nm2 * dij - ri - maxR;
+				double slack = unit + tolerance * (std::abs(nm2 * dij)
+						+ std::abs(ri) + std::abs(maxR));
+				if (lower > sBound + slack) {
+					break;
+				}
+				if (!isSortedNeighbor(i, j)) {
+					nOutdated ++;
+				} else {
+					int64_t i1 = std::min(i, j);
+					int64_t i2 = std::max(i, j);
+					int64_t sij = quantize(sumBranchLengths(i1, i2));
+					if (sij < sThread) {
+						sThread = sij;
+						sBound = sThread * unit;
+						pairsThread.clear();
+					}
+					if (sij == sThread) {
+						pairsThread.push_back(std::make_pair(i1, i2));
+					}
+				}
+			}
+			if (2 * nOutdated > row.size()) {
+				// Discard distances that will never be used again
+				std::size_t nKept = 0;
+				for (std::size_t b = 0; b < row.size(); b ++) {
+					if (isSortedNeighbor(i, row[b].second)) {
+						row[nKept] = row[b];
+						nKept ++;
+					}
+				}
+				row.resize(nKept);
+			}
+		}
+		// Merge the minima of all threads
+#ifdef _OPENMP
+		#pragma omp critical
+#endif
+		{
+			if (sThread < this->sMin) {
+				this->sMin = sThread;
+				pairsMin.swap(pairsThread);
+			} else if (sThread == this->sMin) {
+				pairsMin.insert(pairsMin.end(), pairsThread.begin(),
+						pairsThread.end());
+			}
+		}
+	}
+	// Same minimum OTUs as the exhaustive search
+	std::sort(pairsMin.begin(), pairsMin.end());
+	for (int64_t a = 0; a < nActive; a ++) {
+		this->clusters[this->activeOTUs[a]].sumBranches = MAX_KEY;
+	}
+	this->otusMin.clear();
+	for (std::size_t p = 0; p < pairsMin.size(); p ++) {
+		int64_t i = pairsMin[p].first;
+		if (this->otusMin.empty() || (this->otusMin.back() != i)) {
+			this->clusters[i].sumBranches = this->sMin;
+			this->otusMin.push_back(i);
+		}
+	}
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::tiedPairs(
+		std::vector< std::pair<int64_t, int64_t> >& pairs) const {
+	// Pairs of OTUs at the minimum sum of branch lengths, which determine the
+	// agglomerations of the round, found as in connectComponents() without
+	// modifying the OTUs
+	pairs.clear();
+	for (std::size_t a = 0; a < this->otusMin.size(); a ++) {
+		int64_t i = this->otusMin[a];
+		int64_t j = this->clusters[i].nextOTU;
+		while (j < this->nTaxa) {
+			if (quantize(sumBranchLengths(i, j)) == this->sMin) {
+				pairs.push_back(std::make_pair(i, j));
+			}
+			j = this->clusters[j].nextOTU;
+		}
+	}
+	return;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::connectComponents() {
+	// Nearest neighbors of minimum OTUs, whose S_ij are recomputed and
+	// compared with the minimum as integers
+	int64_t nMin = this->otusMin.size();
+	for (int64_t a = 0; a < nMin; a ++) {
+		int64_t i = this->otusMin[a];
+		this->clusters[i].firstNeighbor = this->neighbors.size();
+		int64_t j = this->clusters[i].nextOTU;
 		while (j < this->nTaxa) {
-			double sij = precisionRound(this->sumBranches.value(i, j));
+			int64_t sij = quantize(sumBranchLengths(i, j));
 			if (sij == this->sMin) {
-				this->clusters[i].nearestNeighbors.push_back(j);
-				this->clusters[j].nearestNeighborOf.push_back(i);
+				this->neighbors.push_back(j);
+				// Edge from j to i, at the front of the edges of j
+				this->edgeOTU.push_back(i);
+				this->edgeNext.push_back(this->clusters[j].firstNeighborOf);
+				this->clusters[j].firstNeighborOf = this->edgeOTU.size() - 1;
 			}
 			j = this->clusters[j].nextOTU;
 		}
-		itmin ++;
+		this->clusters[i].numNeighbors = this->neighbors.size()
+				- this->clusters[i].firstNeighbor;
 	}
 	// Connected components of minimum OTUs and their nearest neighbors
-	this->connected = std::vector<bool>(this->nTaxa, false);
-	itmin = this->otusMin.begin();
-	while (itmin != this->otusMin.end()) {
-		int i = *itmin;
-		if (this->connected[i]) {
-			// Remove from list of minimum OTUS if it is already connected
-			itmin = this->otusMin.erase(itmin);
-		} else {
-			std::list<int> subsetI = connectedComponent(i);
-			this->clusters[i].nearestNeighbors.clear();
-			this->clusters[i].nearestNeighbors = subsetI;
-			itmin ++;
+	this->connected.assign(this->nTaxa, false);
+	int64_t nKept = 0;
+	for (int64_t a = 0; a < nMin; a ++) {
+		int64_t i = this->otusMin[a];
+		// Remove from list of minimum OTUS if it is already connected
+		if (!this->connected[i]) {
+			connectedComponent(i);
+			this->otusMin[nKept] = i;
+			nKept ++;
 		}
 	}
+	this->otusMin.resize(nKept);
 	return;
 }
 
-std::list<int> Phylogeny::connectedComponent(int i) {
-	std::list<int> subsetI;
-	std::queue<int> q;
-	q.push(i);
-	while (!q.empty()) {
-		int j = q.front();
-		q.pop();
+template <typename T>
+void BasicPhylogeny<T>::connectedComponent(int64_t i) {
+	// Breadth-first search, whose connected OTUs are appended to the nearest
+	// neighbors and become the subset of i
+	int64_t first = this->neighbors.size();
+	this->queue.clear();
+	this->queue.push_back(i);
+	std::size_t head = 0;
+	while (head < this->queue.size()) {
+		int64_t j = this->queue[head];
+		head ++;
 		if (!this->connected[j]) {
 			this->connected[j] = true;
-			if (!subsetI.empty()) {
+			if ((int64_t)this->neighbors.size() > first) {
 				// If j is not the first, disconnect it from agglomerable OTUs
 				disconnectOTU(j);
 			}
-			subsetI.push_back(j);
-			double sj = precisionRound(this->clusters[j].sumBranches);
-			if (sj == this->sMin) {
-				std::list<int>::const_iterator itnn =
-						this->clusters[j].nearestNeighbors.begin();
-				while (itnn != this->clusters[j].nearestNeighbors.end()) {
-					int k = *itnn;
-					q.push(k);
-					itnn ++;
+			this->neighbors.push_back(j);
+			const Cluster& cj = this->clusters[j];
+			if (cj.sumBranches == this->sMin) {
+				int64_t last = cj.firstNeighbor + cj.numNeighbors;
+				for (int64_t b = cj.firstNeighbor; b < last; b ++) {
+					this->queue.push_back(this->neighbors[b]);
 				}
 			}
-			std::list<int>::iterator itnnof =
-					this->clusters[j].nearestNeighborOf.begin();
-			while (itnnof != this->clusters[j].nearestNeighborOf.end()) {
-				int k = *itnnof;
-				double sk = precisionRound(this->clusters[k].sumBranches);
-				if (sk == this->sMin) {
-					q.push(k);
+			int64_t e = cj.firstNeighborOf;
+			while (e > -1) {
+				int64_t k = this->edgeOTU[e];
+				if (this->clusters[k].sumBranches == this->sMin) {
+					this->queue.push_back(k);
 				}
-				itnnof ++;
+				e = this->edgeNext[e];
 			}
 		}
 	}
-	subsetI.sort();
-	return subsetI;
+	std::sort(this->neighbors.begin() + first, this->neighbors.end());
+	this->clusters[i].firstNeighbor = first;
+	this->clusters[i].numNeighbors = this->neighbors.size() - first;
+	return;
 }
 
-double Phylogeny::precisionRound(double value) const {
+template <typename T>
+int64_t BasicPhylogeny<T>::quantize(double value) const {
+	// Integer multiple of the unit of precision, so that ties are exact.
 	// Add epsilon to avoid 0.49999999999999... being rounded to 0
 	value += (value >= 0.0)? +this->epsilon : -this->epsilon;
-	return std::round(value * this->pow10precision) / this->pow10precision;
+	double scaled = value * this->pow10precision;
+	// Values out of range, including infinity, saturate
+	const double maxScaled = 9223372036854775808.0;  // 2^63
+	int64_t key;
+	if (scaled >= maxScaled) {
+		key = MAX_KEY;
+	} else if (scaled <= -maxScaled) {
+		key = -MAX_KEY;
+	} else {
+		key = std::llround(scaled);
+	}
+	return key;
 }
 
-void Phylogeny::disconnectOTU(int j) {
-	int i = this->clusters[j].prevOTU;
-	int k = this->clusters[j].nextOTU;
+template <typename T>
+void BasicPhylogeny<T>::disconnectOTU(int64_t j) {
+	int64_t i = this->clusters[j].prevOTU;
+	int64_t k = this->clusters[j].nextOTU;
 	if (i < 0) {
 		this->firstOTU = k;
 	} else {
@@ -266,196 +1267,251 @@ void Phylogeny::disconnectOTU(int j) {
 	return;
 }
 
-void Phylogeny::agglomerateOTUs() {
-	std::list<int>::const_iterator itmin = this->otusMin.begin();
-	while (itmin != this->otusMin.end()) {
-		int i = *itmin;
-		std::list<int> subsetI;
-		std::list<int> subsetIc;
-		splitOTUs(i, subsetI, subsetIc);
-		std::vector<double> rI;
-		std::vector<double> rIc;
+template <typename T>
+void BasicPhylogeny<T>::agglomerateOTUs() {
+	int64_t nMin = this->otusMin.size();
+	for (int64_t a = 0; a < nMin; a ++) {
+		int64_t i = this->otusMin[a];
+		const int64_t* subsetI = nearestNeighbors(i);
+		int64_t nI = this->clusters[i].numNeighbors;
+		splitOTUs(i);
+		const int64_t* subsetIc = this->subsetIc.data();
+		int64_t nIc = this->subsetIc.size();
 		double sumRI;
 		double sumRIc;
-		sumDistances(subsetI, subsetIc, rI, rIc, sumRI, sumRIc);
-		int nI = subsetI.size();
-		int nIc = subsetIc.size();
+		sumDistances(subsetI, nI, sumRI, sumRIc);
+		// Same sum as sumDistancesWithin(subsetI), kept for the new distances
+		this->withinSums[i] = sumRI;
 		if ((nI > 2) && (this->nOTUs > 3)) {
 			this->nPolytomies ++;
 		}
 		// Agglomerate OTUs into a new merger
-		Merger merger;
-		std::list<int>::const_iterator itI = subsetI.begin();
-		while (itI != subsetI.end()) {
-			int j = *itI;
+		Merger merger(nI + 1);
+		for (int64_t b = 0; b < nI; b ++) {
+			int64_t j = subsetI[b];
 			double length;
 			if (nIc > 0) {  // there are still OTUs to agglomerate later
-				length = sumRI / (double)(nI * (nI - 1)) + rIc[j] / (double)nIc
+				length = sumRI / (double)(nI * (nI - 1))
+						+ this->rowSumsIc[j] / (double)nIc
 						- sumRIc / (double)(nI * nIc);
 			} else {  // all remaining OTUs agglomerated together
-				length = rI[j] / (double)(nI - 2)
+				length = this->rowSumsI[j] / (double)(nI - 2)
 						- sumRI / (double)((nI - 1) * (nI - 2));
 			}
 			merger.pushBackOTU(j, length);
-			itI ++;
 		}
 		this->nOTUs -= nI - 1;
 		if (this->nOTUs == 2) {  // there are only 2 remaining OTUs
-			double length = newDistance(subsetI, subsetIc);
-			std::list<int>::const_iterator itIc = subsetIc.begin();
-			int j = *itIc;
+			double length = newDistance(subsetI, nI, subsetIc, nIc);
+			int64_t j = subsetIc[0];
 			merger.pushFrontOTU(j, length);
 			this->nOTUs -= 1;
 		}
-		this->mergers.push_back(merger);
-		itmin ++;
+		this->mergers.push_back(std::move(merger));
 	}
 	return;
 }
 
-void Phylogeny::splitOTUs(int i, std::list<int>& subsetI,
-		std::list<int>& subsetIc) const {
-	subsetI = this->clusters[i].nearestNeighbors;
-	std::list<int>::const_iterator it = this->otusMin.begin();
-	while (it != this->otusMin.end()) {
-		int j = *it;
+template <typename T>
+void BasicPhylogeny<T>::splitOTUs(int64_t i) {
+	// Subset of i is its span of nearest neighbors, and its complement is
+	// built in a buffer reused by every merger
+	this->subsetIc.clear();
+	int64_t nMin = this->otusMin.size();
+	for (int64_t a = 0; a < nMin; a ++) {
+		int64_t j = this->otusMin[a];
 		if (j != i) {
-			std::list<int> subsetJ = this->clusters[j].nearestNeighbors;
-			// Append subsetJ at the end of subsetIc
-			subsetIc.splice(subsetIc.end(), subsetJ);
+			const int64_t* subsetJ = nearestNeighbors(j);
+			this->subsetIc.insert(this->subsetIc.end(), subsetJ,
+					subsetJ + this->clusters[j].numNeighbors);
 		}
-		it ++;
 	}
-	int k = this->firstOTU;
+	int64_t k = this->firstOTU;
 	while (k < this->nTaxa) {
 		if (!this->connected[k]) {
-			subsetIc.push_back(k);
+			this->subsetIc.push_back(k);
 		}
 		k = this->clusters[k].nextOTU;
 	}
 	return;
 }
 
-void Phylogeny::sumDistances(const std::list<int>& subsetI,
-		const std::list<int>& subsetIc, std::vector<double>& rI,
-		std::vector<double>& rIc, double& sumRI, double& sumRIc) const {
-    rI = std::vector<double>(this->nTaxa, 0.0);
-    rIc = std::vector<double>(this->nTaxa, 0.0);
+template <typename T>
+void BasicPhylogeny<T>::sumDistances(const int64_t* subsetI, int64_t nI,
+		double& sumRI, double& sumRIc) {
+	// Only the entries of the OTUs in subsetI are reset and used
     sumRI = 0.0;
     sumRIc = 0.0;
-	std::list<int>::const_iterator iti = subsetI.begin();
-	while (iti != subsetI.end()) {
-		int i = *iti;
-		std::list<int>::const_iterator itj = subsetI.begin();
-		while (itj != subsetI.end()) {
-			int j = *itj;
+    int64_t nIc = this->subsetIc.size();
+	for (int64_t a = 0; a < nI; a ++) {
+		int64_t i = subsetI[a];
+		double ri = 0.0;
+		for (int64_t b = 0; b < nI; b ++) {
+			int64_t j = subsetI[b];
 			if (j != i) {
-				double dij = this->dist.value(i, j);
-				rI[i] += dij;
+				double dij = distance(i, j);
+				ri += dij;
 				if (j > i) {
 					sumRI += dij;
 				}
 			}
-			itj ++;
 		}
-		std::list<int>::const_iterator itk = subsetIc.begin();
-		while (itk != subsetIc.end()) {
-			int k = *itk;
-			double dik = this->dist.value(i, k);
-			rIc[i] += dik;
+		double ric = 0.0;
+		for (int64_t b = 0; b < nIc; b ++) {
+			int64_t k = this->subsetIc[b];
+			double dik = distance(i, k);
+			ric += dik;
 			sumRIc += dik;
-			itk ++;
 		}
-		iti ++;
+		this->rowSumsI[i] = ri;
+		this->rowSumsIc[i] = ric;
 	}
 	return;
 }
 
-void Phylogeny::updateDistances() {
-	std::list<int>::const_iterator iti = this->otusMin.begin();
-	while (iti != this->otusMin.end()) {
-		int i = *iti;
-		std::list<int> subsetI = this->clusters[i].nearestNeighbors;
-		std::list<int>::const_iterator itj = iti;
-		itj ++;
-		while (itj != this->otusMin.end()) {
-			int j = *itj;
-			std::list<int> subsetJ = this->clusters[j].nearestNeighbors;
-			double dij = newDistance(subsetI, subsetJ);
-			this->dist.setValue(i, j, dij);
-			itj ++;
+template <typename T>
+void BasicPhylogeny<T>::updateDistances() {
+	// Incremental sums of distances of the new clusters are computed from
+	// scratch, and the others are left to sumRows() in the next round
+	int64_t nMin = this->otusMin.size();
+	for (int64_t a = 0; (a < nMin) && this->incrementalSums; a ++) {
+		this->rowSums[this->otusMin[a]] = 0.0;
+	}
+	for (int64_t a = 0; a < nMin; a ++) {
+		int64_t i = this->otusMin[a];
+		for (int64_t b = a + 1; b < nMin; b ++) {
+			int64_t j = this->otusMin[b];
+			double dij = newDistance(i, j);
+			setDistance(i, j, dij);
+			if (this->incrementalSums) {
+				this->rowSums[i] += dij;
+				this->rowSums[j] += dij;
+			}
 		}
-		int k = this->firstOTU;
-		while (k < this->nTaxa) {
+		// New distances to the remaining OTUs, which are independent and share
+		// the members and the sum of distances within the new cluster
+		const int64_t* subsetI = nearestNeighbors(i);
+		int64_t nI = this->clusters[i].numNeighbors;
+		double meanII = 0.0;
+		if (nI > 1) {
+			meanII = this->withinSums[i] / (double)(nI * (nI - 1));
+		}
+		int64_t nActive = this->activeOTUs.size();
+		this->newDists.resize(nActive);
+#ifdef _OPENMP
+		#pragma omp parallel for num_threads(this->nThreads) \
+				if (this->nThreads > 1) schedule(static)
+#endif
+		for (int64_t b = 0; b < nActive; b ++) {
+			int64_t k = this->activeOTUs[b];
 			if (!this->connected[k]) {
-				std::list<int> subsetK = {k};  // list with a single object
-				double dik = newDistance(subsetI, subsetK);
-				this->dist.setValue(i, k, dik);
+				double rIk = 0.0;
+				for (int64_t m = 0; m < nI; m ++) {
+					rIk += distance(subsetI[m], k);
+				}
+				double dik = rIk / (double)nI;
+				if (nI > 1) {
+					dik -= meanII;
+				}
+				if (this->incrementalSums) {
+					// R_k loses the distances to subsetI and gains the new one
+					this->rowSums[k] += dik - rIk;
+				}
+				setDistance(i, k, dik);
+				this->newDists[b] = dik;
+			}
+		}
+		// Sum them in list order, as the serial loop does
+		for (int64_t b = 0; (b < nActive) && this->incrementalSums; b ++) {
+			int64_t k = this->activeOTUs[b];
+			if (!this->connected[k]) {
+				this->rowSums[i] += this->newDists[b];
 			}
-			k = this->clusters[k].nextOTU;
 		}
-		iti ++;
 	}
 	return;
 }
 
-double Phylogeny::newDistance(const std::list<int>& subsetI,
-		const std::list<int>& subsetJ) const {
-	int nI = subsetI.size();
-	int nJ = subsetJ.size();
-	double rIJ = sumDistancesBetween(subsetI, subsetJ);
+template <typename T>
+double BasicPhylogeny<T>::newDistance(const int64_t* subsetI, int64_t nI,
+		const int64_t* subsetJ, int64_t nJ) const {
+	double rIJ = sumDistancesBetween(subsetI, nI, subsetJ, nJ);
 	double dij = rIJ / (double)(nI * nJ);
 	if (nI > 1) {
-		double rII = sumDistancesWithin(subsetI);
+		double rII = sumDistancesWithin(subsetI, nI);
 		dij -= rII / (double)(nI * (nI - 1));
 	}
 	if (nJ > 1) {
-		double rJJ = sumDistancesWithin(subsetJ);
+		double rJJ = sumDistancesWithin(subsetJ, nJ);
 		dij -= rJJ / (double)(nJ * (nJ - 1));
 	}
 	return dij;
 }
 
-double Phylogeny::sumDistancesBetween(const std::list<int>& subsetI,
-		const std::list<int>& subsetJ) const {
+template <typename T>
+double BasicPhylogeny<T>::newDistance(int64_t i, int64_t j) const {
+	// Distance between the new clusters i and j, whose sums of distances
+	// within were kept when they were agglomerated
+	int64_t nI = this->clusters[i].numNeighbors;
+	int64_t nJ = this->clusters[j].numNeighbors;
+	double rIJ = sumDistancesBetween(nearestNeighbors(i), nI,
+			nearestNeighbors(j), nJ);
+	double dij = rIJ / (double)(nI * nJ);
+	if (nI > 1) {
+		dij -= this->withinSums[i] / (double)(nI * (nI - 1));
+	}
+	if (nJ > 1) {
+		dij -= this->withinSums[j] / (double)(nJ * (nJ - 1));
+	}
+	return dij;
+}
+
+template <typename T>
+double BasicPhylogeny<T>::sumDistancesBetween(const int64_t* subsetI,
+		int64_t nI, const int64_t* subsetJ, int64_t nJ) const {
     double rIJ = 0.0;
-    std::list<int>::const_iterator iti = subsetI.begin();
-    while (iti != subsetI.end()) {
-    	int i = *iti;
-    	std::list<int>::const_iterator itj = subsetJ.begin();
-    	while (itj != subsetJ.end()) {
-    		int j = *itj;
-    		rIJ += this->dist.value(i, j);
-    		itj ++;
+    for (int64_t a = 0; a < nI; a ++) {
+    	for (int64_t b = 0; b < nJ; b ++) {
+    		rIJ += distance(subsetI[a], subsetJ[b]);
     	}
-    	iti ++;
     }
 	return rIJ;
 }
 
-double Phylogeny::sumDistancesWithin(const std::list<int>& subsetI) const {
+template <typename T>
+double BasicPhylogeny<T>::sumDistancesWithin(const int64_t* subsetI, int64_t nI)
+		const {
     double rII = 0.0;
-    std::list<int>::const_iterator it1 = subsetI.begin();
-    while (it1 != subsetI.end()) {
-    	int i1 = *it1;
-    	std::list<int>::const_iterator it2 = it1;
-    	it2 ++;
-    	while (it2 != subsetI.end()) {
-    		int i2 = *it2;
-    		rII += this->dist.value(i1, i2);
-    		it2 ++;
+    for (int64_t a = 0; a < nI; a ++) {
+    	for (int64_t b = a + 1; b < nI; b ++) {
+    		rII += distance(subsetI[a], subsetI[b]);
     	}
-    	it1 ++;
     }
 	return rII;
 }
 
-void Phylogeny::clearNearestNeighbors() {
-	int i = this->firstOTU;
+template <typename T>
+const int64_t* BasicPhylogeny<T>::nearestNeighbors(int64_t i) const {
+	return this->neighbors.data() + this->clusters[i].firstNeighbor;
+}
+
+template <typename T>
+void BasicPhylogeny<T>::clearNearestNeighbors() {
+	// Spans and edges are emptied, keeping the capacity of their arenas
+	int64_t i = this->firstOTU;
 	while (i < this->nTaxa) {
-	  	this->clusters[i].nearestNeighbors.clear();
-		this->clusters[i].nearestNeighborOf.clear();
+		this->clusters[i].firstNeighbor = 0;
+		this->clusters[i].numNeighbors = 0;
+		this->clusters[i].firstNeighborOf = -1;
 		i = this->clusters[i].nextOTU;
 	}
+	this->neighbors.clear();
+	this->edgeOTU.clear();
+	this->edgeNext.clear();
 	return;
 }
+
+// Storage types of the distances
+template class BasicPhylogeny<double>;
+template class BasicPhylogeny<float>;
+template class BasicPhylogeny<int32_t>;
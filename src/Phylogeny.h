@@ -1,65 +1,144 @@
 #ifndef PHYLOGENY_H_
 #define PHYLOGENY_H_
 
-#include <list>  // std::list
+#include <chrono>  // std::chrono::steady_clock
+#include <cstdint>  // int32_t, int64_t
+#include <istream>  // std::istream
+#include <limits>  // std::numeric_limits
+#include <ostream>  // std::ostream
 #include <string>  // std::string
+#include <utility>  // std::pair
 #include <vector>  // std::vector
 
 #include "Matrix.h"
 #include "Merger.h"
+#include "Profile.h"
 
-// Phylogenetic Tree
-class Phylogeny {
+const int64_t MAX_KEY = std::numeric_limits<int64_t>::max();
+
+// Phylogenetic Tree, whose distances are stored as values of type T
+template <typename T>
+class BasicPhylogeny {
 public:
-	Phylogeny();
-	Phylogeny(const Matrix& dist, int precision);
+	BasicPhylogeny();
+	BasicPhylogeny(const BasicMatrix<T>& dist, int precision);
+	BasicPhylogeny(BasicMatrix<T>&& dist, int precision);
+	void setDistances(BasicMatrix<T>&& dist, int precision);
+    void setIncrementalSums(bool incremental);
+    void setThreads(int threads);
+    void setBoundedSearch(bool bounded);
+    void setProfiling(bool profiling);
+    void setProgress(Progress* progress);
     void reconstruct();
+    std::vector<BasicPhylogeny> sweep(const std::vector<int>& precisions);
+    int getPrecision() const;
+    Storage getStorage() const;
     int numPolytomies() const;
-    std::vector<Merger> getMergers() const;
+    const std::vector<Merger>& getMergers() const;
+    const std::vector<RoundProfile>& getProfile() const;
     std::string getNewick(const std::vector<std::string>& labels) const;
+    void getEdges(std::vector<int64_t>& parents, std::vector<int64_t>& children,
+    		std::vector<double>& lengths) const;
+    bool isFinished() const;
+    void writeState(std::ostream& out, const std::vector<std::string>& labels);
+    void readState(std::istream& in, std::vector<std::string>& labels);
 private:
     class Cluster {
     public:
     	Cluster();
-    	int prevOTU;  // Previous agglomerable OTU
-    	int nextOTU;  // Next agglomerable OTU
-		double sumBranches;  // Sums of branch lengths NN TO THE RIGHT
-		std::list<int> nearestNeighbors;  // Nearest neighbors TO THE RIGHT
-		std::list<int> nearestNeighborOf;  // OTUs that current one is NN of
+    	int64_t prevOTU;  // Previous agglomerable OTU
+    	int64_t nextOTU;  // Next agglomerable OTU
+		int64_t sumBranches;  // Quantized sum of branch lengths NN TO THE RIGHT
+		int64_t firstNeighbor;  // First nearest neighbor TO THE RIGHT, in arena
+		int64_t numNeighbors;  // Number of nearest neighbors TO THE RIGHT
+		int64_t firstNeighborOf;  // First edge to the OTUs this one is NN of
     };
-    int nTaxa;  // Number of taxa
-	int nOTUs;  // Number of OTUs still to agglomerate
+    typedef std::pair<T, int32_t> Neighbor;  // Stored distance to an OTU
+    int64_t nTaxa;  // Number of taxa
+	int64_t nOTUs;  // Number of OTUs still to agglomerate
 	int nPolytomies;  // Number of polytomies
-    Matrix dist;  // Distances between OTUs
-	Matrix sumBranches;  // Sums of branch lengths
+    BasicMatrix<T> dist;  // Distances between OTUs, by rows of slots
+    std::vector<int64_t> slots;  // Row of every agglomerable OTU in dist
+    std::vector<double> slotSums;  // R_i by rows of dist, -INF if unused
+	std::vector<double> rowSums;  // Sums of distances R_i of agglomerable OTUs
+	std::vector<double> rowMins;  // Minimum S_ij TO THE RIGHT of every OTU
+	bool incrementalSums;  // Update R_i instead of computing it every round
+	int nThreads;  // Number of threads
+	bool boundedSearch;  // Skip S_ij that cannot reach the minimum
+	int64_t nRounds;  // Number of rounds of agglomerations
+	std::vector< std::vector<Neighbor> > sortedDists;  // Sorted distances
+	std::vector<int64_t> sortedRound;  // Round when distances were sorted
+	bool profiling;  // Record the work and the time of every round
+	std::vector<RoundProfile> profile;  // Profile of every round
+	Progress* progress;  // Observer notified after every round, if any
+	std::chrono::steady_clock::time_point lapStart;  // Start of the phase
     double epsilon;  // Very small number
     int precision;  // Number of significant decimal digits
     double pow10precision;  // 10 to the power of significant decimal digits
     std::vector<Cluster> clusters;  // Clusters
-    int firstOTU;  // First agglomerable OTU
-	double sMin;  // Minimum sum of branch lengths
-	std::list<int> otusMin;  // OTUS with the minimum sum of branch lengths
+    int64_t firstOTU;  // First agglomerable OTU
+    std::vector<int64_t> activeOTUs;  // Agglomerable OTUs in list order
+    std::vector<double> newDists;  // New distances to the agglomerable OTUs
+    std::vector<double> withinSums;  // Sums of distances within new clusters
+	int64_t sMin;  // Quantized minimum sum of branch lengths
+	std::vector<int64_t> otusMin;  // OTUS with the minimum sum of branch lengths
 	std::vector<bool> connected;  // Connected components at the minimum sum
+	std::vector<int64_t> neighbors;  // Arena of nearest neighbors and subsets
+	std::vector<int64_t> edgeOTU;  // OTU at the end of every edge to a NN
+	std::vector<int64_t> edgeNext;  // Next edge from the same OTU
+	std::vector<int64_t> queue;  // Queue of the breadth-first search
+	std::vector<int64_t> subsetIc;  // Complement of the subset to agglomerate
+	std::vector<double> rowSumsI;  // Sums of distances within the subset
+	std::vector<double> rowSumsIc;  // Sums of distances to the complement
     std::vector<Merger> mergers;  // History of mergers
-	void sumBranchLengths();
+    void init(int precision);
+    void initBuffers();
+    int maxPrecision() const;
+    void setPrecision(int precision);
+    void startLap();
+    void lap(double& seconds);
+    int64_t bytes() const;
+    int64_t mergerTree(std::vector<int64_t>& firstChild,
+    		std::vector<int64_t>& children) const;
+	void listOTUs();
+	void compactDistances();
+	double distance(int64_t i, int64_t j) const;
+	void setDistance(int64_t i, int64_t j, double value);
+	void startRound(RoundProfile& round);
+	void finishRound(RoundProfile& round);
+	void sumRows();
+	double sumBranchLengths(int64_t i, int64_t j) const;
 	void minimizeSumBranches();
+	void minimizeRows();
+	void selectMinimum();
+	void tiedPairs(std::vector< std::pair<int64_t, int64_t> >& pairs) const;
+	void sortDistances(bool all);
+	bool isSortedNeighbor(int64_t i, int64_t j) const;
+	void minimizeBoundedSumBranches();
     void connectComponents();
-    std::list<int> connectedComponent(int i);
-    double precisionRound(double value) const;
-    void disconnectOTU(int j);
+    void connectedComponent(int64_t i);
+    int64_t quantize(double value) const;
+    void disconnectOTU(int64_t j);
     void agglomerateOTUs();
-    void splitOTUs(int i, std::list<int>& subsetI, std::list<int>& subsetIc)
-    		const;
-    void sumDistances(const std::list<int>& subsetI,
-    		const std::list<int>& subsetIc, std::vector<double>& rI,
-			std::vector<double>& rIc, double& sumRI, double& sumRIc) const;
+    void splitOTUs(int64_t i);
+    void sumDistances(const int64_t* subsetI, int64_t nI, double& sumRI,
+    		double& sumRIc);
     void updateDistances();
-    double newDistance(const std::list<int>& subsetI,
-    		const std::list<int>& subsetJ) const;
-    double sumDistancesBetween(const std::list<int>& subsetI,
-    		const std::list<int>& subsetJ) const;
-    double sumDistancesWithin(const std::list<int>& subsetI) const;
+    double newDistance(const int64_t* subsetI, int64_t nI,
+    		const int64_t* subsetJ, int64_t nJ) const;
+    double newDistance(int64_t i, int64_t j) const;
+    double sumDistancesBetween(const int64_t* subsetI, int64_t nI,
+    		const int64_t* subsetJ, int64_t nJ) const;
+    double sumDistancesWithin(const int64_t* subsetI, int64_t nI) const;
+    const int64_t* nearestNeighbors(int64_t i) const;
     void clearNearestNeighbors();
 };
 
+// Storage of the distances of a state written by writeState()
+Storage stateStorage(std::istream& in);
+
+typedef BasicPhylogeny<double> Phylogeny;
+typedef BasicPhylogeny<float> FloatPhylogeny;
+typedef BasicPhylogeny<int32_t> FixedPhylogeny;
+
 #endif /* PHYLOGENY_H_ */
@@ -0,0 +1,21 @@
+#ifndef POPCOUNT_H_
+#define POPCOUNT_H_
+
+#include <cstdint>  // uint64_t
+
+// Number of bits set in word, with the hardware instruction if enabled, or
+// else with bits counted in parallel. It is defined here so that the loops
+// over packed words inline it
+inline int popcount(uint64_t word) {
+#ifdef __POPCNT__
+	return __builtin_popcountll(word);
+#else
+	word = word - ((word >> 1) & 0x5555555555555555ULL);
+	word = (word & 0x3333333333333333ULL)
+			+ ((word >> 2) & 0x3333333333333333ULL);
+	word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+#endif /* POPCOUNT_H_ */
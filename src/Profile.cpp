@@ -0,0 +1,19 @@
+#include "Profile.h"
+
+#include <cstdint>  // int64_t
+
+RoundProfile::RoundProfile() {
+	this->round = 0;
+	this->nOTUs = 0;
+	this->nTies = 0;
+	this->nMergers = 0;
+	this->maxMerged = 0;
+	this->bytes = 0;
+	this->sums = 0.0;
+	this->minimize = 0.0;
+	this->connect = 0.0;
+	this->agglomerate = 0.0;
+	this->update = 0.0;
+}
+
+Progress::~Progress() {}
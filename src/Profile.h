@@ -0,0 +1,31 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <cstdint>  // int64_t
+
+// Work of a round of agglomerations, and seconds spent in every phase
+class RoundProfile {
+public:
+	RoundProfile();
+	int64_t round;  // Number of the round, from 1
+	int64_t nOTUs;  // Number of OTUs to agglomerate at the start of the round
+	int64_t nTies;  // Number of pairs of OTUs tied at the minimum sum
+	int64_t nMergers;  // Number of mergers of the round
+	int64_t maxMerged;  // Largest number of OTUs merged together
+	int64_t bytes;  // Bytes held by the engine at the end of the round
+	double sums;  // Listing OTUs and sums of distances R_i
+	double minimize;  // Search of the minimum sum of branch lengths S_ij
+	double connect;  // Connected components of the minimum OTUs
+	double agglomerate;  // Mergers and their branch lengths
+	double update;  // New distances, and sorting them in the bounded search
+};
+
+// Observer of the progress of a reconstruction, notified after every round
+class Progress {
+public:
+	virtual ~Progress();
+	// Returns false to stop the reconstruction, which is left unfinished
+	virtual bool update(int64_t round, int64_t nOTUs) = 0;
+};
+
+#endif /* PROFILE_H_ */
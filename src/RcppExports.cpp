@@ -11,21 +11,212 @@ Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
 // rcppMfnj
-Rcpp::List rcppMfnj(const Rcpp::StringVector& labels, const Rcpp::NumericVector& x, int digits);
-RcppExport SEXP _mphylo_rcppMfnj(SEXP labelsSEXP, SEXP xSEXP, SEXP digitsSEXP) {
+Rcpp::List rcppMfnj(const Rcpp::StringVector& labels, Rcpp::NumericVector x, Rcpp::IntegerVector digits, bool incremental, int threads, bool bounded, bool inplace, bool newick, const std::string& storage, bool profile, Rcpp::RObject progress, const std::string& cache, double cacheSize);
+RcppExport SEXP _mphylo_rcppMfnj(SEXP labelsSEXP, SEXP xSEXP, SEXP digitsSEXP, SEXP incrementalSEXP, SEXP threadsSEXP, SEXP boundedSEXP, SEXP inplaceSEXP, SEXP newickSEXP, SEXP storageSEXP, SEXP profileSEXP, SEXP progressSEXP, SEXP cacheSEXP, SEXP cacheSizeSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::StringVector& >::type labels(labelsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type x(xSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type digits(digitsSEXP);
+    Rcpp::traits::input_parameter< bool >::type incremental(incrementalSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type bounded(boundedSEXP);
+    Rcpp::traits::input_parameter< bool >::type inplace(inplaceSEXP);
+    Rcpp::traits::input_parameter< bool >::type newick(newickSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type storage(storageSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    Rcpp::traits::input_parameter< Rcpp::RObject >::type progress(progressSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type cache(cacheSEXP);
+    Rcpp::traits::input_parameter< double >::type cacheSize(cacheSizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcppMfnj(labels, x, digits, incremental, threads, bounded, inplace, newick, storage, profile, progress, cache, cacheSize));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// rcppMfnjFile
+Rcpp::List rcppMfnjFile(const std::string& file, Rcpp::IntegerVector digits, bool incremental, int threads, bool bounded, bool inplace, bool newick, const std::string& storage, bool profile, Rcpp::RObject progress, const std::string& cache, double cacheSize);
+RcppExport SEXP _mphylo_rcppMfnjFile(SEXP fileSEXP, SEXP digitsSEXP, SEXP incrementalSEXP, SEXP threadsSEXP, SEXP boundedSEXP, SEXP inplaceSEXP, SEXP newickSEXP, SEXP storageSEXP, SEXP profileSEXP, SEXP progressSEXP, SEXP cacheSEXP, SEXP cacheSizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type file(fileSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type digits(digitsSEXP);
+    Rcpp::traits::input_parameter< bool >::type incremental(incrementalSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type bounded(boundedSEXP);
+    Rcpp::traits::input_parameter< bool >::type inplace(inplaceSEXP);
+    Rcpp::traits::input_parameter< bool >::type newick(newickSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type storage(storageSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    Rcpp::traits::input_parameter< Rcpp::RObject >::type progress(progressSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type cache(cacheSEXP);
+    Rcpp::traits::input_parameter< double >::type cacheSize(cacheSizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcppMfnjFile(file, digits, incremental, threads, bounded, inplace, newick, storage, profile, progress, cache, cacheSize));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// rcppMfnjDNA
+Rcpp::List rcppMfnjDNA(const Rcpp::StringVector& labels, const Rcpp::RawMatrix& x, const std::string& model, bool pairwise, Rcpp::IntegerVector digits, bool incremental, int threads, bool bounded, bool newick, const std::string& storage, bool profile, Rcpp::RObject progress, const std::string& cache, double cacheSize);
+RcppExport SEXP _mphylo_rcppMfnjDNA(SEXP labelsSEXP, SEXP xSEXP, SEXP modelSEXP, SEXP pairwiseSEXP, SEXP digitsSEXP, SEXP incrementalSEXP, SEXP threadsSEXP, SEXP boundedSEXP, SEXP newickSEXP, SEXP storageSEXP, SEXP profileSEXP, SEXP progressSEXP, SEXP cacheSEXP, SEXP cacheSizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::StringVector& >::type labels(labelsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::RawMatrix& >::type x(xSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type model(modelSEXP);
+    Rcpp::traits::input_parameter< bool >::type pairwise(pairwiseSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type digits(digitsSEXP);
+    Rcpp::traits::input_parameter< bool >::type incremental(incrementalSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type bounded(boundedSEXP);
+    Rcpp::traits::input_parameter< bool >::type newick(newickSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type storage(storageSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    Rcpp::traits::input_parameter< Rcpp::RObject >::type progress(progressSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type cache(cacheSEXP);
+    Rcpp::traits::input_parameter< double >::type cacheSize(cacheSizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcppMfnjDNA(labels, x, model, pairwise, digits, incremental, threads, bounded, newick, storage, profile, progress, cache, cacheSize));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// rcppMfnjFasta
+Rcpp::List rcppMfnjFasta(const std::string& file, const std::string& model, bool pairwise, Rcpp::IntegerVector digits, bool incremental, int threads, bool bounded, bool newick, const std::string& storage, bool profile, Rcpp::RObject progress, const std::string& cache, double cacheSize);
+RcppExport SEXP _mphylo_rcppMfnjFasta(SEXP fileSEXP, SEXP modelSEXP, SEXP pairwiseSEXP, SEXP digitsSEXP, SEXP incrementalSEXP, SEXP threadsSEXP, SEXP boundedSEXP, SEXP newickSEXP, SEXP storageSEXP, SEXP profileSEXP, SEXP progressSEXP, SEXP cacheSEXP, SEXP cacheSizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type file(fileSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type model(modelSEXP);
+    Rcpp::traits::input_parameter< bool >::type pairwise(pairwiseSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type digits(digitsSEXP);
+    Rcpp::traits::input_parameter< bool >::type incremental(incrementalSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type bounded(boundedSEXP);
+    Rcpp::traits::input_parameter< bool >::type newick(newickSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type storage(storageSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    Rcpp::traits::input_parameter< Rcpp::RObject >::type progress(progressSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type cache(cacheSEXP);
+    Rcpp::traits::input_parameter< double >::type cacheSize(cacheSizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcppMfnjFasta(file, model, pairwise, digits, incremental, threads, bounded, newick, storage, profile, progress, cache, cacheSize));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// rcppWriteDistances
+void rcppWriteDistances(const Rcpp::StringVector& labels, const Rcpp::NumericVector& x, const std::string& file);
+RcppExport SEXP _mphylo_rcppWriteDistances(SEXP labelsSEXP, SEXP xSEXP, SEXP fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::StringVector& >::type labels(labelsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type x(xSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type file(fileSEXP);
+    rcppWriteDistances(labels, x, file);
+    return R_NilValue;
+END_RCPP
+}
+
+// rcppAppendDistances
+void rcppAppendDistances(const Rcpp::StringVector& labels, const Rcpp::NumericVector& x, const std::string& file);
+RcppExport SEXP _mphylo_rcppAppendDistances(SEXP labelsSEXP, SEXP xSEXP, SEXP fileSEXP) {
+BEGIN_RCPP
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const Rcpp::StringVector& >::type labels(labelsSEXP);
     Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type x(xSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type file(fileSEXP);
+    rcppAppendDistances(labels, x, file);
+    return R_NilValue;
+END_RCPP
+}
+
+// rcppMfnjAsync
+SEXP rcppMfnjAsync(const Rcpp::StringVector& labels, const Rcpp::NumericVector& x, Rcpp::IntegerVector digits, bool incremental, int threads, bool bounded, bool newick, const std::string& storage);
+RcppExport SEXP _mphylo_rcppMfnjAsync(SEXP labelsSEXP, SEXP xSEXP, SEXP digitsSEXP, SEXP incrementalSEXP, SEXP threadsSEXP, SEXP boundedSEXP, SEXP newickSEXP, SEXP storageSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::StringVector& >::type labels(labelsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type x(xSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type digits(digitsSEXP);
+    Rcpp::traits::input_parameter< bool >::type incremental(incrementalSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type bounded(boundedSEXP);
+    Rcpp::traits::input_parameter< bool >::type newick(newickSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type storage(storageSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcppMfnjAsync(labels, x, digits, incremental, threads, bounded, newick, storage));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// rcppAsyncStatus
+Rcpp::List rcppAsyncStatus(SEXP job);
+RcppExport SEXP _mphylo_rcppAsyncStatus(SEXP jobSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type job(jobSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcppAsyncStatus(job));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// rcppAsyncCancel
+void rcppAsyncCancel(SEXP job);
+RcppExport SEXP _mphylo_rcppAsyncCancel(SEXP jobSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type job(jobSEXP);
+    rcppAsyncCancel(job);
+    return R_NilValue;
+END_RCPP
+}
+
+// rcppAsyncValue
+Rcpp::List rcppAsyncValue(SEXP job);
+RcppExport SEXP _mphylo_rcppAsyncValue(SEXP jobSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type job(jobSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcppAsyncValue(job));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// rcppMfnjBatch
+Rcpp::List rcppMfnjBatch(const Rcpp::StringVector& labels, Rcpp::NumericMatrix x, int digits, bool incremental, int threads, bool bounded, bool newick, bool splits);
+RcppExport SEXP _mphylo_rcppMfnjBatch(SEXP labelsSEXP, SEXP xSEXP, SEXP digitsSEXP, SEXP incrementalSEXP, SEXP threadsSEXP, SEXP boundedSEXP, SEXP newickSEXP, SEXP splitsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::StringVector& >::type labels(labelsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type x(xSEXP);
     Rcpp::traits::input_parameter< int >::type digits(digitsSEXP);
-    rcpp_result_gen = Rcpp::wrap(rcppMfnj(labels, x, digits));
+    Rcpp::traits::input_parameter< bool >::type incremental(incrementalSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type bounded(boundedSEXP);
+    Rcpp::traits::input_parameter< bool >::type newick(newickSEXP);
+    Rcpp::traits::input_parameter< bool >::type splits(splitsSEXP);
+    rcpp_result_gen = Rcpp::wrap(rcppMfnjBatch(labels, x, digits, incremental, threads, bounded, newick, splits));
     return rcpp_result_gen;
 END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_mphylo_rcppMfnj", (DL_FUNC) &_mphylo_rcppMfnj, 3},
+    {"_mphylo_rcppMfnj", (DL_FUNC) &_mphylo_rcppMfnj, 13},
+    {"_mphylo_rcppMfnjFile", (DL_FUNC) &_mphylo_rcppMfnjFile, 12},
+    {"_mphylo_rcppMfnjDNA", (DL_FUNC) &_mphylo_rcppMfnjDNA, 14},
+    {"_mphylo_rcppMfnjFasta", (DL_FUNC) &_mphylo_rcppMfnjFasta, 13},
+    {"_mphylo_rcppWriteDistances", (DL_FUNC) &_mphylo_rcppWriteDistances, 3},
+    {"_mphylo_rcppAppendDistances", (DL_FUNC) &_mphylo_rcppAppendDistances, 3},
+    {"_mphylo_rcppMfnjAsync", (DL_FUNC) &_mphylo_rcppMfnjAsync, 8},
+    {"_mphylo_rcppAsyncStatus", (DL_FUNC) &_mphylo_rcppAsyncStatus, 1},
+    {"_mphylo_rcppAsyncCancel", (DL_FUNC) &_mphylo_rcppAsyncCancel, 1},
+    {"_mphylo_rcppAsyncValue", (DL_FUNC) &_mphylo_rcppAsyncValue, 1},
+    {"_mphylo_rcppMfnjBatch", (DL_FUNC) &_mphylo_rcppMfnjBatch, 8},
     {NULL, NULL, 0}
 };
 
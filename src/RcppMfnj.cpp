@@ -1,35 +1,462 @@
-#include <algorithm>  // std::max, std::min
-#include <cmath>  // std::floor, std::log10
-#include <sstream>  // std::ostringstream
+#include "RcppMfnj.h"
+
+#include <cstdint>  // int32_t, int64_t, uint64_t
+#include <fstream>  // std::ifstream
+#include <stdexcept>  // std::runtime_error
 #include <string>  // std::string
+#include <utility>  // std::move
 #include <vector>  // std::vector
 
 #include <Rcpp.h>
 
+#include "Alignment.h"
+#include "DistanceFile.h"
 #include "Matrix.h"
 #include "Phylogeny.h"
+#include "Profile.h"
+#include "ResultCache.h"
 
-// [[Rcpp::export]]
-Rcpp::List rcppMfnj(const Rcpp::StringVector& labels,
-		const Rcpp::NumericVector& x, int digits = -1) {
-	Matrix dist(Rcpp::as< std::vector<double> >(x));
-	if (digits < 0) {
-		digits = dist.precision();
-	}
-	// Check maximum precision
-	double maxDist = std::max(dist.maxValue(), 1.0);
-	int intDigits = 1 + (int)std::floor(std::log10(maxDist));
-	int maxPrecision = MAX_DIGITS - intDigits - 1;
-	digits = std::min(digits, maxPrecision);
-	// Reconstruct phylogenetic tree from distances
-	Phylogeny* phylo = new Phylogeny(dist, digits);
-	phylo->reconstruct();
+// Progress reported to an R function, if any. Interrupts of the user stop the
+// reconstruction after the current round, without unwinding the engine
+class RcppProgress : public Progress {
+public:
+	RcppProgress(const Rcpp::RObject& callback);
+	bool update(int64_t round, int64_t nOTUs);
+	bool isInterrupted() const;
+private:
+	Rcpp::RObject callback;  // R function(round, otus), or NULL
+	bool interrupted;  // Interrupted by the user
+	static void checkInterrupt(void* data);
+};
+
+RcppProgress::RcppProgress(const Rcpp::RObject& callback) {
+	this->callback = callback;
+	this->interrupted = false;
+}
+
+bool RcppProgress::update(int64_t round, int64_t nOTUs) {
+	if (!this->callback.isNULL()) {
+		Rcpp::Function f(this->callback);
+		f((double)round, (double)nOTUs);
+	}
+	// R_CheckUserInterrupt() jumps out of the top-level context on interrupts
+	this->interrupted = !R_ToplevelExec(checkInterrupt, nullptr);
+	return !this->interrupted;
+}
+
+bool RcppProgress::isInterrupted() const {
+	return this->interrupted;
+}
+
+void RcppProgress::checkInterrupt(void*) {
+	R_CheckUserInterrupt();
+	return;
+}
+
+// Profile of the rounds as a data frame
+static Rcpp::DataFrame rcppProfile(const std::vector<RoundProfile>& rounds) {
+	int64_t nRounds = rounds.size();
+	Rcpp::NumericVector round(nRounds);
+	Rcpp::NumericVector otus(nRounds);
+	Rcpp::NumericVector ties(nRounds);
+	Rcpp::NumericVector mergers(nRounds);
+	Rcpp::NumericVector largest(nRounds);
+	Rcpp::NumericVector bytes(nRounds);
+	Rcpp::NumericVector sums(nRounds);
+	Rcpp::NumericVector minimize(nRounds);
+	Rcpp::NumericVector connect(nRounds);
+	Rcpp::NumericVector agglomerate(nRounds);
+	Rcpp::NumericVector update(nRounds);
+	for (int64_t r = 0; r < nRounds; r ++) {
+		round[r] = (double)rounds[r].round;
+		otus[r] = (double)rounds[r].nOTUs;
+		ties[r] = (double)rounds[r].nTies;
+		mergers[r] = (double)rounds[r].nMergers;
+		largest[r] = (double)rounds[r].maxMerged;
+		bytes[r] = (double)rounds[r].bytes;
+		sums[r] = rounds[r].sums;
+		minimize[r] = rounds[r].minimize;
+		connect[r] = rounds[r].connect;
+		agglomerate[r] = rounds[r].agglomerate;
+		update[r] = rounds[r].update;
+	}
+	return Rcpp::DataFrame::create(
+			Rcpp::Named("round") = round,
+			Rcpp::Named("otus") = otus,
+			Rcpp::Named("ties") = ties,
+			Rcpp::Named("mergers") = mergers,
+			Rcpp::Named("largest") = largest,
+			Rcpp::Named("bytes") = bytes,
+			Rcpp::Named("sums") = sums,
+			Rcpp::Named("minimize") = minimize,
+			Rcpp::Named("connect") = connect,
+			Rcpp::Named("agglomerate") = agglomerate,
+			Rcpp::Named("update") = update);
+}
+
+Rcpp::List rcppPhylo(const std::vector<int64_t>& parents,
+		const std::vector<int64_t>& children, const std::vector<double>& lengths,
+		int nNodes, const Rcpp::StringVector& labels) {
+	// Nodes are numbered from 1 in R
+	int64_t nEdges = parents.size();
+	Rcpp::IntegerMatrix edge(nEdges, 2);
+	Rcpp::NumericVector edgeLength(nEdges);
+	for (int64_t e = 0; e < nEdges; e ++) {
+		edge(e, 0) = (int)(parents[e] + 1);
+		edge(e, 1) = (int)(children[e] + 1);
+		edgeLength[e] = lengths[e];
+	}
+	Rcpp::List tree = Rcpp::List::create(
+			Rcpp::Named("edge") = edge,
+			Rcpp::Named("edge.length") = edgeLength,
+			Rcpp::Named("Nnode") = nNodes,
+			Rcpp::Named("tip.label") = labels);
+	tree.attr("class") = "phylo";
+	tree.attr("order") = "cladewise";
+	return tree;
+}
+
+StorageGroup::StorageGroup(Storage type, double scale, bool fallback) {
+	this->type = type;
+	this->scale = scale;
+	this->fallback = fallback;
+}
+
+std::vector<StorageGroup> storageGroups(const Matrix& dist,
+		const std::vector<int>& digits, const std::string& storage) {
+	// Fixed-point stores the distances in the same unit at every precision
+	// that fits, whereas single precision uses the unit of each precision.
+	// Each one falls back to double at the precisions that do not fit: fixed
+	// point if their unit does not fit in 32-bit integers, and single
+	// precision if the distances need more than 6 significant digits
+	std::vector<StorageGroup> groups;
+	for (std::size_t p = 0; p < digits.size(); p ++) {
+		double scale = 0.0;
+		Storage type = DOUBLE_STORAGE;
+		if (storage == "fixed") {
+			scale = fixedScale(dist, digits[p]);
+			type = FIXED_STORAGE;
+		} else if (storage == "float") {
+			scale = floatScale(dist, digits[p]);
+			type = FLOAT_STORAGE;
+		}
+		bool fallback = (type != DOUBLE_STORAGE) && (scale == 0.0);
+		if (fallback) {
+			type = DOUBLE_STORAGE;
+		}
+		std::size_t g = 0;
+		while ((g < groups.size()) && ((groups[g].type != type)
+				|| (groups[g].scale != scale))) {
+			g ++;
+		}
+		if (g == groups.size()) {
+			groups.push_back(StorageGroup(type, scale, fallback));
+		}
+		groups[g].precisions.push_back(p);
+	}
+	return groups;
+}
+
+std::string storageName(Storage type) {
+	const char* names[] = {"double", "float", "fixed"};
+	return names[type];
+}
+
+template <typename T>
+static Rcpp::List treeList(const BasicPhylogeny<T>& phylo, int digits,
+		const Rcpp::StringVector& labels, bool newick, bool profile) {
+	// Tree as an object of class "phylo" of package ape
+	std::vector<int64_t> parents;
+	std::vector<int64_t> children;
+	std::vector<double> lengths;
+	phylo.getEdges(parents, children, lengths);
+	Rcpp::List tree = rcppPhylo(parents, children, lengths,
+			(int)phylo.getMergers().size(), labels);
+	// Newick string and profile only on request
+	Rcpp::RObject nwk = R_NilValue;
+	if (newick) {
+		nwk = Rcpp::wrap(
+				phylo.getNewick(Rcpp::as< std::vector<std::string> >(labels)));
+	}
+	Rcpp::RObject rounds = R_NilValue;
+	if (profile) {
+		rounds = rcppProfile(phylo.getProfile());
+	}
 	// Save results
 	Rcpp::List lst = Rcpp::List::create(
 			Rcpp::Named("digits") = digits,
-			Rcpp::Named("nwk") =
-				phylo->getNewick(Rcpp::as< std::vector<std::string> >(labels)),
-			Rcpp::Named("polytomies") = phylo->numPolytomies());
-	delete phylo;
+			Rcpp::Named("labels") = labels,
+			Rcpp::Named("nwk") = nwk,
+			Rcpp::Named("phylo") = tree,
+			Rcpp::Named("polytomies") = phylo.numPolytomies(),
+			Rcpp::Named("storage") = storageName(phylo.getStorage()),
+			Rcpp::Named("profile") = rounds);
 	return lst;
 }
+
+template <typename T>
+static BasicMatrix<T> converted(Matrix& dist, const StorageGroup& group,
+		bool release) {
+	// Compact storage only reads dist, which is released once the last group
+	// is converted
+	BasicMatrix<T> values(dist, group.scale);
+	if (release) {
+		dist = Matrix();
+	}
+	return values;
+}
+
+template <>
+Matrix converted(Matrix& dist, const StorageGroup& group, bool release) {
+	// Distances in double are taken over by the last group, unless they fell
+	// back from compact storage, which leaves them untouched in a copy
+	if (group.fallback || !release) {
+		Matrix copy(dist);
+		if (release) {
+			dist = Matrix();
+		}
+		return copy;
+	}
+	return std::move(dist);
+}
+
+template <typename T>
+static void reconstructTrees(Matrix& dist, const StorageGroup& group,
+		bool release, const Rcpp::StringVector& labels,
+		const std::vector<int>& digits, bool incremental, int threads,
+		bool bounded, bool newick, bool profile, RcppProgress& progress,
+		ResultCache* cache, const std::vector<std::string>& keys,
+		std::vector<Rcpp::List>& lists) {
+	// Reconstruct the phylogenetic trees of the precisions of the group,
+	// which share the rounds whose ties agree. Trees found in the cache are
+	// not reconstructed, unless profiled, and the distances are only
+	// converted if any tree is missing. The engine is destroyed if the
+	// progress function raises an error
+	std::vector<std::string> names;
+	if (cache != nullptr) {
+		names = Rcpp::as< std::vector<std::string> >(labels);
+	}
+	const std::vector<std::size_t>& indices = group.precisions;
+	std::vector< BasicPhylogeny<T> > trees(indices.size());
+	std::vector<std::size_t> missing;
+	for (std::size_t g = 0; g < indices.size(); g ++) {
+		if ((cache == nullptr) || profile
+				|| !cache->load(keys[indices[g]], trees[g], names)) {
+			missing.push_back(g);
+		}
+	}
+	if (!missing.empty()) {
+		std::vector<int> precisions(missing.size());
+		for (std::size_t m = 0; m < missing.size(); m ++) {
+			precisions[m] = digits[indices[missing[m]]];
+		}
+		BasicPhylogeny<T> phylo(converted<T>(dist, group, release),
+				precisions.front());
+		phylo.setIncrementalSums(incremental);
+		phylo.setThreads(threads);
+		phylo.setBoundedSearch(bounded);
+		phylo.setProfiling(profile);
+		phylo.setProgress(&progress);
+		if (missing.size() == 1) {
+			phylo.reconstruct();
+			if (progress.isInterrupted()) {
+				throw Rcpp::internal::InterruptedException();
+			}
+			trees[missing.front()] = std::move(phylo);
+		} else {
+			std::vector< BasicPhylogeny<T> > swept = phylo.sweep(precisions);
+			if (progress.isInterrupted()) {
+				throw Rcpp::internal::InterruptedException();
+			}
+			for (std::size_t m = 0; m < missing.size(); m ++) {
+				trees[missing[m]] = std::move(swept[m]);
+			}
+		}
+		// Trees that cannot be cached are still returned
+		for (std::size_t m = 0; (cache != nullptr) && (m < missing.size());
+				m ++) {
+			try {
+				cache->store(keys[indices[missing[m]]], trees[missing[m]],
+						names);
+			} catch (const std::runtime_error& e) {
+				Rcpp::warning(e.what());
+			}
+		}
+	}
+	for (std::size_t g = 0; g < indices.size(); g ++) {
+		lists[indices[g]] = treeList(trees[g], digits[indices[g]], labels,
+				newick, profile);
+	}
+	return;
+}
+
+static Rcpp::List reconstruct(Matrix&& dist, const Rcpp::StringVector& labels,
+		const Rcpp::IntegerVector& precisions, bool incremental, int threads,
+		bool bounded, bool newick, const std::string& storage, bool profile,
+		const Rcpp::RObject& progress, const std::string& cache,
+		double cacheSize) {
+	// Reconstruct phylogenetic tree from distances, or a list of trees if
+	// there are several precisions
+	std::vector<int> digits(precisions.begin(), precisions.end());
+	if (digits.empty()) {
+		Rcpp::stop("'digits' must have at least one value");
+	}
+	effectivePrecisions(dist, digits, threads);
+	// Compact storage only reads dist, which is converted and released before
+	// the last group of precisions is reconstructed
+	std::vector<StorageGroup> groups = storageGroups(dist, digits, storage);
+	// Cached trees are keyed by the hash of the distances and labels, the
+	// effective precision, the storage of its group, the incremental sums
+	// and the search
+	ResultCache results(cache, (int64_t)cacheSize);
+	std::vector<std::string> keys(digits.size());
+	if (!cache.empty()) {
+		uint64_t hash = ResultCache::hash(dist,
+				Rcpp::as< std::vector<std::string> >(labels));
+		for (std::size_t g = 0; g < groups.size(); g ++) {
+			for (std::size_t i = 0; i < groups[g].precisions.size(); i ++) {
+				std::size_t p = groups[g].precisions[i];
+				keys[p] = ResultCache::key(hash, digits[p], groups[g].type,
+						groups[g].scale, groups[g].fallback, incremental,
+						bounded);
+			}
+		}
+	}
+	ResultCache* cached = cache.empty()? nullptr : &results;
+	RcppProgress observer(progress);
+	std::vector<Rcpp::List> lists(digits.size());
+	for (std::size_t g = 0; g < groups.size(); g ++) {
+		bool release = (g + 1 == groups.size());
+		if (groups[g].type == FIXED_STORAGE) {
+			reconstructTrees<int32_t>(dist, groups[g], release, labels,
+					digits, incremental, threads, bounded, newick, profile,
+					observer, cached, keys, lists);
+		} else if (groups[g].type == FLOAT_STORAGE) {
+			reconstructTrees<float>(dist, groups[g], release, labels, digits,
+					incremental, threads, bounded, newick, profile, observer,
+					cached, keys, lists);
+		} else {
+			reconstructTrees<double>(dist, groups[g], release, labels, digits,
+					incremental, threads, bounded, newick, profile, observer,
+					cached, keys, lists);
+		}
+	}
+	Rcpp::List lst;
+	if (digits.size() == 1) {
+		lst = lists.front();
+	} else {
+		lst = Rcpp::List(digits.size());
+		for (std::size_t p = 0; p < digits.size(); p ++) {
+			lst[p] = lists[p];
+		}
+	}
+	return lst;
+}
+
+// [[Rcpp::export]]
+Rcpp::List rcppMfnj(const Rcpp::StringVector& labels, Rcpp::NumericVector x,
+		Rcpp::IntegerVector digits = Rcpp::IntegerVector::create(-1),
+		bool incremental = false, int threads = 1, bool bounded = false,
+		bool inplace = false, bool newick = true,
+		const std::string& storage = "double", bool profile = false,
+		Rcpp::RObject progress = R_NilValue, const std::string& cache = "",
+		double cacheSize = 0.0) {
+	// Distances are copied once from R memory, unless the caller passes in x
+	// a private copy that the reconstruction may overwrite, as mfnj() does
+	// with the result of as.numeric(). Compact storage only reads x, which is
+	// converted into a matrix of its own
+	Matrix dist(x.begin(), x.size(), inplace || (storage != "double"));
+	return reconstruct(std::move(dist), labels, digits, incremental, threads,
+			bounded, newick, storage, profile, progress, cache, cacheSize);
+}
+
+// [[Rcpp::export]]
+Rcpp::List rcppMfnjFile(const std::string& file,
+		Rcpp::IntegerVector digits = Rcpp::IntegerVector::create(-1),
+		bool incremental = false, int threads = 1, bool bounded = false,
+		bool inplace = false, bool newick = true,
+		const std::string& storage = "double", bool profile = false,
+		Rcpp::RObject progress = R_NilValue, const std::string& cache = "",
+		double cacheSize = 0.0) {
+	// Distances are mapped from the file, which is only updated if inplace
+	// in double precision, since compact storage only reads it
+	DistanceFile distFile(file, inplace && (storage == "double"));
+	if (distFile.getLabels().size() < 3) {
+		Rcpp::stop("'file' must have at least 3 taxa");
+	}
+	Matrix dist(distFile.values(), distFile.numValues(), true);
+	Rcpp::StringVector labels = Rcpp::wrap(distFile.getLabels());
+	return reconstruct(std::move(dist), labels, digits, incremental, threads,
+			bounded, newick, storage, profile, progress, cache, cacheSize);
+}
+
+// [[Rcpp::export]]
+Rcpp::List rcppMfnjDNA(const Rcpp::StringVector& labels,
+		const Rcpp::RawMatrix& x, const std::string& model,
+		bool pairwise = false,
+		Rcpp::IntegerVector digits = Rcpp::IntegerVector::create(-1),
+		bool incremental = false, int threads = 1, bool bounded = false,
+		bool newick = true, const std::string& storage = "double",
+		bool profile = false, Rcpp::RObject progress = R_NilValue,
+		const std::string& cache = "", double cacheSize = 0.0) {
+	// Distances are computed from the packed sequences into the matrix of the
+	// reconstruction, without any "dist" in R. Sequences are the rows of x
+	Matrix dist;
+	{
+		Alignment alignment;
+		int64_t n = x.nrow();
+		for (int64_t i = 0; i < n; i ++) {
+			alignment.addCodes(Rcpp::as<std::string>(labels[i]),
+					x.begin() + i, x.ncol(), n);
+		}
+		dist = alignment.distances(Alignment::parseModel(model), pairwise,
+				threads);
+	}
+	return reconstruct(std::move(dist), labels, digits, incremental, threads,
+			bounded, newick, storage, profile, progress, cache, cacheSize);
+}
+
+// [[Rcpp::export]]
+Rcpp::List rcppMfnjFasta(const std::string& file, const std::string& model,
+		bool pairwise = false,
+		Rcpp::IntegerVector digits = Rcpp::IntegerVector::create(-1),
+		bool incremental = false, int threads = 1, bool bounded = false,
+		bool newick = true, const std::string& storage = "double",
+		bool profile = false, Rcpp::RObject progress = R_NilValue,
+		const std::string& cache = "", double cacheSize = 0.0) {
+	// Sequences are read and packed without being loaded into R
+	Matrix dist;
+	Rcpp::StringVector labels;
+	{
+		Alignment alignment;
+		std::ifstream in(file.c_str(), std::ios::binary);
+		if (!in) {
+			Rcpp::stop("cannot open " + file);
+		}
+		alignment.read(in);
+		if (alignment.numSequences() < 3) {
+			Rcpp::stop("'x' must have at least 3 sequences");
+		}
+		dist = alignment.distances(Alignment::parseModel(model), pairwise,
+				threads);
+		labels = Rcpp::wrap(alignment.getLabels());
+	}
+	return reconstruct(std::move(dist), labels, digits, incremental, threads,
+			bounded, newick, storage, profile, progress, cache, cacheSize);
+}
+
+// [[Rcpp::export]]
+void rcppWriteDistances(const Rcpp::StringVector& labels,
+		const Rcpp::NumericVector& x, const std::string& file) {
+	DistanceFile::write(file, x.begin(), x.size(),
+			Rcpp::as< std::vector<std::string> >(labels));
+	return;
+}
+
+// [[Rcpp::export]]
+void rcppAppendDistances(const Rcpp::StringVector& labels,
+		const Rcpp::NumericVector& x, const std::string& file) {
+	DistanceFile::append(file, x.begin(),
+			Rcpp::as< std::vector<std::string> >(labels));
+	return;
+}
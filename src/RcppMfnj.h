@@ -0,0 +1,39 @@
+#ifndef RCPPMFNJ_H_
+#define RCPPMFNJ_H_
+
+#include <cstddef>  // std::size_t
+#include <cstdint>  // int64_t
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+#include <Rcpp.h>
+
+#include "Matrix.h"
+
+// Tree as an object of class "phylo" of package ape
+Rcpp::List rcppPhylo(const std::vector<int64_t>& parents,
+		const std::vector<int64_t>& children, const std::vector<double>& lengths,
+		int nNodes, const Rcpp::StringVector& labels);
+
+// Precisions whose distances share a storage and a scale, and therefore the
+// rounds of a sweep
+class StorageGroup {
+public:
+    StorageGroup(Storage type, double scale, bool fallback);
+    Storage type;  // Storage of the distances
+    double scale;  // Scale of compact storage, or 0 in double precision
+    bool fallback;  // Compact storage requested, but the distances do not fit
+    std::vector<std::size_t> precisions;  // Indices of the precisions
+};
+
+// Groups of the precisions by the storage of their distances, which is chosen
+// for every precision on its own, so that its tree does not depend on the
+// other precisions requested. Groups follow the order of their first
+// precision. It does not call R
+std::vector<StorageGroup> storageGroups(const Matrix& dist,
+		const std::vector<int>& digits, const std::string& storage);
+
+// Name of the storage, as in argument storage of mfnj()
+std::string storageName(Storage type);
+
+#endif /* RCPPMFNJ_H_ */
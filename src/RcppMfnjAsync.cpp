@@ -0,0 +1,330 @@
+#include <atomic>  // std::atomic
+#include <cstddef>  // std::size_t
+#include <cstdint>  // int32_t, int64_t
+#include <exception>  // std::exception
+#include <string>  // std::string
+#include <thread>  // std::thread
+#include <utility>  // std::move
+#include <vector>  // std::vector
+
+#include <Rcpp.h>
+
+#include "Matrix.h"
+#include "Phylogeny.h"
+#include "Profile.h"
+#include "RcppMfnj.h"
+
+// States of an asynchronous reconstruction
+enum AsyncState {
+	RUNNING_STATE,  // The worker is still reconstructing
+	FINISHED_STATE,  // All the trees were reconstructed
+	CANCELLED_STATE,  // Stopped between rounds on request
+	FAILED_STATE  // Stopped by an error of the engine
+};
+
+// Tree of a finished reconstruction, with the edges and Newick string that
+// R objects are built from
+class AsyncTree {
+public:
+	AsyncTree();
+	int digits;  // Number of significant decimal digits used as precision
+	Storage storage;  // Storage of the distances
+	int polytomies;  // Number of polytomies
+	int nNodes;  // Number of internal nodes
+	std::vector<int64_t> parents;  // Parent of every edge
+	std::vector<int64_t> children;  // Child of every edge
+	std::vector<double> lengths;  // Length of every edge
+	std::string newick;  // Newick string, if requested
+};
+
+AsyncTree::AsyncTree() {
+	this->digits = 0;
+	this->storage = DOUBLE_STORAGE;
+	this->polytomies = 0;
+	this->nNodes = 0;
+}
+
+// Reconstruction running in a worker thread with its own copy of the
+// distances and labels, which never calls R. It publishes its progress after
+// every round, where it also stops if it was cancelled
+class AsyncReconstruction : public Progress {
+public:
+	AsyncReconstruction(Matrix&& dist, const std::vector<std::string>& labels,
+			const std::vector<int>& digits, bool incremental, int threads,
+			bool bounded, bool newick, const std::string& storage);
+	AsyncReconstruction(const AsyncReconstruction& other) = delete;
+	AsyncReconstruction& operator=(const AsyncReconstruction& other) = delete;
+	~AsyncReconstruction();
+	bool update(int64_t round, int64_t nOTUs);
+	void cancel();
+	void wait();
+	AsyncState getState() const;
+	int64_t getRound() const;
+	int64_t numOTUs() const;
+	const std::string& getError() const;
+	const std::vector<std::string>& getLabels() const;
+	const std::vector<AsyncTree>& getTrees() const;
+private:
+	Matrix dist;  // Distances, released once the engine takes them
+	std::vector<std::string> labels;  // Labels of the taxa
+	std::vector<int> digits;  // Precisions of the trees
+	bool incremental;  // Update sums of distances incrementally
+	int threads;  // Number of threads of the engine
+	bool bounded;  // Bounded search of the minimum sum of branch lengths
+	bool newick;  // Newick strings of the trees
+	std::string storage;  // Storage of the distances
+	std::atomic<int> state;  // AsyncState of the reconstruction
+	std::atomic<bool> cancelled;  // Cancellation requested
+	std::atomic<int64_t> round;  // Last round finished
+	std::atomic<int64_t> nOTUs;  // OTUs still to agglomerate
+	std::string error;  // Message of the error, if failed
+	std::vector<AsyncTree> trees;  // Trees, once finished
+	std::thread worker;  // Thread of the reconstruction
+	void run();
+	template <typename T>
+	bool reconstruct(BasicMatrix<T>&& values, const StorageGroup& group);
+	template <typename T>
+	void saveTree(const BasicPhylogeny<T>& phylo, std::size_t precision);
+};
+
+AsyncReconstruction::AsyncReconstruction(Matrix&& dist,
+		const std::vector<std::string>& labels, const std::vector<int>& digits,
+		bool incremental, int threads, bool bounded, bool newick,
+		const std::string& storage) : state(RUNNING_STATE), cancelled(false),
+		round(0), nOTUs(labels.size()) {
+	this->dist = std::move(dist);
+	this->labels = labels;
+	this->digits = digits;
+	this->incremental = incremental;
+	this->threads = threads;
+	this->bounded = bounded;
+	this->newick = newick;
+	this->storage = storage;
+	// The worker starts once all the members are set
+	this->worker = std::thread(&AsyncReconstruction::run, this);
+}
+
+AsyncReconstruction::~AsyncReconstruction() {
+	// A running worker stops at the end of its current round
+	cancel();
+	wait();
+}
+
+bool AsyncReconstruction::update(int64_t round, int64_t nOTUs) {
+	this->round = round;
+	this->nOTUs = nOTUs;
+	return !this->cancelled;
+}
+
+void AsyncReconstruction::cancel() {
+	this->cancelled = true;
+	return;
+}
+
+void AsyncReconstruction::wait() {
+	if (this->worker.joinable()) {
+		this->worker.join();
+	}
+	return;
+}
+
+AsyncState AsyncReconstruction::getState() const {
+	return (AsyncState)this->state.load();
+}
+
+int64_t AsyncReconstruction::getRound() const {
+	return this->round;
+}
+
+int64_t AsyncReconstruction::numOTUs() const {
+	return this->nOTUs;
+}
+
+const std::string& AsyncReconstruction::getError() const {
+	return this->error;
+}
+
+const std::vector<std::string>& AsyncReconstruction::getLabels() const {
+	return this->labels;
+}
+
+const std::vector<AsyncTree>& AsyncReconstruction::getTrees() const {
+	return this->trees;
+}
+
+void AsyncReconstruction::run() {
+	// Precision detection and conversions also run in the worker. Errors of
+	// the engine, such as running out of memory, are kept for value(). The
+	// state is published last, once the trees or the error are set
+	AsyncState finalState = FAILED_STATE;
+	try {
+		effectivePrecisions(this->dist, this->digits, this->threads);
+		// Precisions are grouped by storage as in rcppMfnj(), and the
+		// distances are released once the last group takes them over
+		std::vector<StorageGroup> groups = storageGroups(this->dist,
+				this->digits, this->storage);
+		this->trees.resize(this->digits.size());
+		bool finished = true;
+		for (std::size_t g = 0; finished && (g < groups.size()); g ++) {
+			const StorageGroup& group = groups[g];
+			bool release = (g + 1 == groups.size());
+			if (group.type == FIXED_STORAGE) {
+				FixedMatrix fixed(this->dist, group.scale);
+				if (release) {
+					this->dist = Matrix();
+				}
+				finished = reconstruct(std::move(fixed), group);
+			} else if (group.type == FLOAT_STORAGE) {
+				FloatMatrix single(this->dist, group.scale);
+				if (release) {
+					this->dist = Matrix();
+				}
+				finished = reconstruct(std::move(single), group);
+			} else if (release) {
+				finished = reconstruct(std::move(this->dist), group);
+			} else {
+				finished = reconstruct(Matrix(this->dist), group);
+			}
+		}
+		finalState = finished? FINISHED_STATE : CANCELLED_STATE;
+	} catch (const std::exception& e) {
+		this->error = e.what();
+	}
+	this->state = finalState;
+	return;
+}
+
+template <typename T>
+bool AsyncReconstruction::reconstruct(BasicMatrix<T>&& values,
+		const StorageGroup& group) {
+	// Precisions of the group share the rounds whose ties agree, and none of
+	// its trees is kept if the reconstruction was cancelled
+	std::vector<int> precisions(group.precisions.size());
+	for (std::size_t g = 0; g < precisions.size(); g ++) {
+		precisions[g] = this->digits[group.precisions[g]];
+	}
+	BasicPhylogeny<T> phylo(std::move(values), precisions.front());
+	phylo.setIncrementalSums(this->incremental);
+	phylo.setThreads(this->threads);
+	phylo.setBoundedSearch(this->bounded);
+	phylo.setProgress(this);
+	std::vector< BasicPhylogeny<T> > phylos;
+	if (precisions.size() == 1) {
+		phylo.reconstruct();
+		phylos.push_back(std::move(phylo));
+	} else {
+		phylos = phylo.sweep(precisions);
+	}
+	bool finished = true;
+	for (std::size_t p = 0; p < phylos.size(); p ++) {
+		finished = finished && phylos[p].isFinished();
+	}
+	for (std::size_t p = 0; finished && (p < phylos.size()); p ++) {
+		saveTree(phylos[p], group.precisions[p]);
+	}
+	return finished;
+}
+
+template <typename T>
+void AsyncReconstruction::saveTree(const BasicPhylogeny<T>& phylo,
+		std::size_t precision) {
+	AsyncTree tree;
+	tree.digits = this->digits[precision];
+	tree.storage = phylo.getStorage();
+	tree.polytomies = phylo.numPolytomies();
+	tree.nNodes = phylo.getMergers().size();
+	phylo.getEdges(tree.parents, tree.children, tree.lengths);
+	if (this->newick) {
+		tree.newick = phylo.getNewick(this->labels);
+	}
+	this->trees[precision] = std::move(tree);
+	return;
+}
+
+static AsyncReconstruction& asyncReconstruction(SEXP job) {
+	// External pointers are null once restored from a saved session
+	Rcpp::XPtr<AsyncReconstruction> ptr(job);
+	if (ptr.get() == nullptr) {
+		Rcpp::stop("the reconstruction no longer exists");
+	}
+	return *ptr;
+}
+
+// [[Rcpp::export]]
+SEXP rcppMfnjAsync(const Rcpp::StringVector& labels,
+		const Rcpp::NumericVector& x,
+		Rcpp::IntegerVector digits = Rcpp::IntegerVector::create(-1),
+		bool incremental = false, int threads = 1, bool bounded = false,
+		bool newick = true, const std::string& storage = "double") {
+	// Distances and labels are copied, since R may change or free its objects
+	// while the worker runs. The worker is cancelled and joined when the
+	// pointer is garbage collected
+	std::vector<int> precisions(digits.begin(), digits.end());
+	if (precisions.empty()) {
+		Rcpp::stop("'digits' must have at least one value");
+	}
+	Matrix dist(x.begin(), x.size());
+	Rcpp::XPtr<AsyncReconstruction> job(new AsyncReconstruction(
+			std::move(dist), Rcpp::as< std::vector<std::string> >(labels),
+			precisions, incremental, threads, bounded, newick, storage), true);
+	return job;
+}
+
+// [[Rcpp::export]]
+Rcpp::List rcppAsyncStatus(SEXP job) {
+	AsyncReconstruction& reconstruction = asyncReconstruction(job);
+	const char* states[] = {"running", "finished", "cancelled", "failed"};
+	return Rcpp::List::create(
+			Rcpp::Named("state") = states[reconstruction.getState()],
+			Rcpp::Named("round") = (double)reconstruction.getRound(),
+			Rcpp::Named("otus") = (double)reconstruction.numOTUs());
+}
+
+// [[Rcpp::export]]
+void rcppAsyncCancel(SEXP job) {
+	asyncReconstruction(job).cancel();
+	return;
+}
+
+static Rcpp::List asyncTreeList(const AsyncTree& tree,
+		const Rcpp::StringVector& labels) {
+	// Same elements as the trees of rcppMfnj(), with no profile
+	Rcpp::RObject nwk = R_NilValue;
+	if (!tree.newick.empty()) {
+		nwk = Rcpp::wrap(tree.newick);
+	}
+	return Rcpp::List::create(
+			Rcpp::Named("digits") = tree.digits,
+			Rcpp::Named("labels") = labels,
+			Rcpp::Named("nwk") = nwk,
+			Rcpp::Named("phylo") = rcppPhylo(tree.parents, tree.children,
+					tree.lengths, tree.nNodes, labels),
+			Rcpp::Named("polytomies") = tree.polytomies,
+			Rcpp::Named("storage") = storageName(tree.storage),
+			Rcpp::Named("profile") = R_NilValue);
+}
+
+// [[Rcpp::export]]
+Rcpp::List rcppAsyncValue(SEXP job) {
+	// Trees of the reconstruction, once the worker has finished. R objects
+	// are only built here, in the main thread
+	AsyncReconstruction& reconstruction = asyncReconstruction(job);
+	reconstruction.wait();
+	if (reconstruction.getState() == CANCELLED_STATE) {
+		Rcpp::stop("the reconstruction was cancelled");
+	} else if (reconstruction.getState() == FAILED_STATE) {
+		Rcpp::stop(reconstruction.getError());
+	}
+	Rcpp::StringVector labels = Rcpp::wrap(reconstruction.getLabels());
+	const std::vector<AsyncTree>& trees = reconstruction.getTrees();
+	Rcpp::List lst;
+	if (trees.size() == 1) {
+		lst = asyncTreeList(trees.front(), labels);
+	} else {
+		lst = Rcpp::List(trees.size());
+		for (std::size_t t = 0; t < trees.size(); t ++) {
+			lst[t] = asyncTreeList(trees[t], labels);
+		}
+	}
+	return lst;
+}
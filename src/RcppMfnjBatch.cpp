@@ -0,0 +1,180 @@
+#include <algorithm>  // std::copy, std::max, std::sort, std::unique
+#include <cstdint>  // int64_t, uint64_t
+#include <map>  // std::map
+#include <string>  // std::string
+#include <utility>  // std::move
+#include <vector>  // std::vector
+
+#include <Rcpp.h>
+
+#include "Matrix.h"
+#include "Phylogeny.h"
+#include "Popcount.h"
+#include "RcppMfnj.h"
+
+// Splits of a tree as bitsets of the taxa on the side without the first one
+static void treeSplits(const std::vector<int64_t>& parents,
+		const std::vector<int64_t>& children, int64_t nTaxa,
+		std::vector< std::vector<uint64_t> >& splits) {
+	int64_t nWords = (nTaxa + 63) / 64;
+	int64_t nNodes = 1;
+	for (std::size_t e = 0; e < parents.size(); e ++) {
+		nNodes = std::max(nNodes, children[e] - nTaxa + 1);
+	}
+	// Taxa below every merger, filled from the last edge in preorder
+	std::vector< std::vector<uint64_t> > clades(nNodes,
+			std::vector<uint64_t>(nWords, 0));
+	splits.clear();
+	for (int64_t e = (int64_t)parents.size() - 1; e >= 0; e --) {
+		std::vector<uint64_t>& clade = clades[parents[e] - nTaxa];
+		int64_t c = children[e];
+		if (c < nTaxa) {
+			clade[c / 64] |= (uint64_t)1 << (c % 64);
+		} else {
+			const std::vector<uint64_t>& below = clades[c - nTaxa];
+			std::vector<uint64_t> split = below;
+			int64_t nBelow = 0;
+			for (int64_t w = 0; w < nWords; w ++) {
+				clade[w] |= below[w];
+				nBelow += popcount(below[w]);
+			}
+			if ((split[0] & 1) != 0) {  // complement of the first taxon side
+				for (int64_t w = 0; w < nWords; w ++) {
+					split[w] = ~split[w];
+				}
+				if (nTaxa % 64 != 0) {
+					split[nWords - 1] &= ((uint64_t)1 << (nTaxa % 64)) - 1;
+				}
+				nBelow = nTaxa - nBelow;
+			}
+			// Trivial splits of a single taxon are not counted
+			if ((nBelow > 1) && (nBelow < nTaxa - 1)) {
+				splits.push_back(split);
+			}
+		}
+	}
+	// Both children of a bifurcating root give the same split
+	std::sort(splits.begin(), splits.end());
+	splits.erase(std::unique(splits.begin(), splits.end()), splits.end());
+	return;
+}
+
+// [[Rcpp::export]]
+Rcpp::List rcppMfnjBatch(const Rcpp::StringVector& labels,
+		Rcpp::NumericMatrix x, int digits = -1, bool incremental = false,
+		int threads = 1, bool bounded = false, bool newick = false,
+		bool splits = false) {
+	// Every column of x holds the distances of a replicate, which are copied
+	// into a buffer of the thread and reconstructed by its own engine
+	int64_t nValues = x.nrow();
+	int64_t nReplicates = x.ncol();
+	int64_t nTaxa = labels.size();
+	const double* values = x.begin();
+	std::vector<std::string> names = Rcpp::as< std::vector<std::string> >(
+			labels);
+	std::vector<int> precisions(nReplicates);
+	std::vector<int> polytomies(nReplicates);
+	std::vector< std::vector<int64_t> > parents(nReplicates);
+	std::vector< std::vector<int64_t> > children(nReplicates);
+	std::vector< std::vector<double> > lengths(nReplicates);
+	std::vector<int> nNodes(nReplicates);
+	std::vector<std::string> nwks(newick? nReplicates : 0);
+	std::map<std::vector<uint64_t>, int> counts;
+	threads = std::max(threads, 1);
+#ifdef _OPENMP
+	#pragma omp parallel num_threads(threads) if (threads > 1)
+#endif
+	{
+		Phylogeny phylo;
+		phylo.setIncrementalSums(incremental);
+		phylo.setBoundedSearch(bounded);
+		std::vector<double> buffer(nValues);
+		std::vector< std::vector<uint64_t> > treeSplitsBuffer;
+		std::map<std::vector<uint64_t>, int> countsThread;
+#ifdef _OPENMP
+		#pragma omp for schedule(dynamic, 1)
+#endif
+		for (int64_t b = 0; b < nReplicates; b ++) {
+			std::copy(values + b * nValues, values + (b + 1) * nValues,
+					buffer.begin());
+			Matrix dist(buffer.data(), nValues, true);
+			int precision = digits;
+			if (precision < 0) {
+				precision = dist.precision();
+			}
+			phylo.setDistances(std::move(dist), precision);
+			phylo.reconstruct();
+			precisions[b] = phylo.getPrecision();
+			polytomies[b] = phylo.numPolytomies();
+			nNodes[b] = phylo.getMergers().size();
+			phylo.getEdges(parents[b], children[b], lengths[b]);
+			if (newick) {
+				nwks[b] = phylo.getNewick(names);
+			}
+			if (splits) {
+				treeSplits(parents[b], children[b], nTaxa, treeSplitsBuffer);
+				for (std::size_t s = 0; s < treeSplitsBuffer.size(); s ++) {
+					countsThread[treeSplitsBuffer[s]] ++;
+				}
+			}
+		}
+		// Merge the split frequencies of all threads
+#ifdef _OPENMP
+		#pragma omp critical
+#endif
+		{
+			std::map<std::vector<uint64_t>, int>::const_iterator it =
+					countsThread.begin();
+			while (it != countsThread.end()) {
+				counts[it->first] += it->second;
+				it ++;
+			}
+		}
+	}
+	// Trees as objects of class "phylo" of package ape
+	Rcpp::List trees(nReplicates);
+	for (int64_t b = 0; b < nReplicates; b ++) {
+		trees[b] = rcppPhylo(parents[b], children[b], lengths[b], nNodes[b],
+				labels);
+	}
+	Rcpp::RObject nwk = R_NilValue;
+	if (newick) {
+		nwk = Rcpp::wrap(nwks);
+	}
+	// Split frequencies as an object of class "prop.part" of package ape,
+	// whose first part holds all the taxa
+	Rcpp::RObject parts = R_NilValue;
+	if (splits) {
+		Rcpp::List partList(counts.size() + 1);
+		Rcpp::IntegerVector number(counts.size() + 1);
+		partList[0] = Rcpp::IntegerVector(Rcpp::seq_len(nTaxa));
+		number[0] = nReplicates;
+		int64_t p = 1;
+		std::map<std::vector<uint64_t>, int>::const_iterator it =
+				counts.begin();
+		while (it != counts.end()) {
+			std::vector<int> taxa;
+			for (int64_t i = 0; i < nTaxa; i ++) {
+				if ((it->first[i / 64] >> (i % 64)) & 1) {
+					taxa.push_back(i + 1);
+				}
+			}
+			partList[p] = Rcpp::wrap(taxa);
+			number[p] = it->second;
+			p ++;
+			it ++;
+		}
+		partList.attr("number") = number;
+		partList.attr("labels") = labels;
+		partList.attr("class") = "prop.part";
+		parts = partList;
+	}
+	// Save results
+	Rcpp::List lst = Rcpp::List::create(
+			Rcpp::Named("digits") = Rcpp::wrap(precisions),
+			Rcpp::Named("trees") = trees,
+			Rcpp::Named("nwk") = nwk,
+			Rcpp::Named("polytomies") = Rcpp::wrap(polytomies),
+			Rcpp::Named("splits") = parts);
+	return lst;
+}
@@ -0,0 +1,233 @@
+#include "ResultCache.h"
+
+#include <algorithm>  // std::sort
+#include <cstdint>  // int32_t, int64_t, uint64_t
+#include <cstdio>  // std::remove, std::snprintf
+#include <cstring>  // std::memcpy
+#include <ctime>  // std::time_t
+#include <fstream>  // std::ifstream, std::ofstream
+#include <stdexcept>  // std::runtime_error
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+#include <dirent.h>  // closedir, opendir, readdir
+#include <sys/stat.h>  // stat
+#include <utime.h>  // utime
+
+#include "Matrix.h"
+#include "Phylogeny.h"
+#include "TemporaryFile.h"
+
+static const char* ENTRY_SUFFIX = ".mfnj";
+static const uint64_t HASH_PRIME = 0x9E3779B97F4A7C15ULL;
+
+// Cached state found in the directory
+class CacheEntry {
+public:
+	CacheEntry(const std::string& path, std::time_t modified, int64_t bytes);
+	std::string path;  // Path of the state
+	std::time_t modified;  // Time of the last use
+	int64_t bytes;  // Size of the state
+};
+
+CacheEntry::CacheEntry(const std::string& path, std::time_t modified,
+		int64_t bytes) {
+	this->path = path;
+	this->modified = modified;
+	this->bytes = bytes;
+}
+
+static bool usedBefore(const CacheEntry& a, const CacheEntry& b) {
+	return a.modified < b.modified;
+}
+
+static uint64_t rotate(uint64_t word, int bits) {
+	return (word << bits) | (word >> (64 - bits));
+}
+
+static uint64_t mix(uint64_t h) {
+	// Finalizer of SplitMix64, where every bit of h changes half of the others
+	h ^= h >> 30;
+	h *= 0xBF58476D1CE4E5B9ULL;
+	h ^= h >> 27;
+	h *= 0x94D049BB133111EBULL;
+	h ^= h >> 31;
+	return h;
+}
+
+static uint64_t hashBytes(const void* data, int64_t nBytes, uint64_t seed) {
+	// Words go round-robin to four lanes, whose multiplications overlap in the
+	// pipeline, and the rotations carry their high bits back to the low ones
+	const unsigned char* bytes = (const unsigned char*)data;
+	uint64_t lanes[4] = {seed, seed ^ HASH_PRIME, rotate(seed, 32), ~seed};
+	int64_t nWords = nBytes / 8;
+	int64_t w = 0;
+	for (; w + 4 <= nWords; w += 4) {
+		for (int l = 0; l < 4; l ++) {
+			uint64_t word;
+			std::memcpy(&word, bytes + (w + l) * 8, 8);
+			lanes[l] = rotate((lanes[l] ^ word) * HASH_PRIME, 31);
+		}
+	}
+	for (; w < nWords; w ++) {
+		uint64_t word;
+		std::memcpy(&word, bytes + w * 8, 8);
+		lanes[0] = rotate((lanes[0] ^ word) * HASH_PRIME, 31);
+	}
+	uint64_t tail = 0;
+	std::memcpy(&tail, bytes + nWords * 8, nBytes - nWords * 8);
+	uint64_t h = mix(lanes[0] ^ tail) ^ (uint64_t)nBytes;
+	for (int l = 1; l < 4; l ++) {
+		h = mix(h * HASH_PRIME + lanes[l]);
+	}
+	return h;
+}
+
+ResultCache::ResultCache(const std::string& directory, int64_t maxBytes) {
+	this->directory = directory;
+	this->maxBytes = maxBytes;
+}
+
+uint64_t ResultCache::hash(const Matrix& dist,
+		const std::vector<std::string>& labels) {
+	// Columns of the lower triangle are hashed in order, each one seeded by
+	// the hash of the previous ones, and followed by the labels
+	int64_t n = dist.numRows();
+	uint64_t h = hashBytes(&n, sizeof(int64_t), 0);
+	for (int64_t j = 0; j + 1 < n; j ++) {
+		h = hashBytes(dist.column(j) + j + 1, (n - j - 1) * sizeof(double), h);
+	}
+	for (std::size_t i = 0; i < labels.size(); i ++) {
+		h = hashBytes(labels[i].c_str(), labels[i].size() + 1, h);
+	}
+	return h;
+}
+
+std::string ResultCache::key(uint64_t hash, int precision, Storage storage,
+		double scale, bool fallback, bool incremental, bool bounded) {
+	// Options that change the rounding of the reconstruction: the storage
+	// with its scale, and whether compact storage fell back to double. The
+	// search gives the same tree, but trees of one search are not returned
+	// for the other. The number of threads is not keyed
+	int32_t options[5] = {precision, storage, fallback? 1 : 0,
+			incremental? 1 : 0, bounded? 1 : 0};
+	uint64_t h = hashBytes(options, sizeof(options), hash);
+	h = hashBytes(&scale, sizeof(double), h);
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)h);
+	return name;
+}
+
+template <typename T>
+bool ResultCache::load(const std::string& key, BasicPhylogeny<T>& phylo,
+		const std::vector<std::string>& labels) const {
+	// States that cannot be read are missed, as well as those of other labels
+	// after a collision of hashes. Hits become the most recently used
+	std::string file = path(key);
+	std::ifstream in(file.c_str(), std::ios::binary);
+	bool found = false;
+	if (in) {
+		std::vector<std::string> stateLabels;
+		try {
+			phylo.readState(in, stateLabels);
+			found = phylo.isFinished() && (stateLabels == labels);
+		} catch (const std::runtime_error&) {
+			found = false;
+		}
+	}
+	if (found) {
+		utime(file.c_str(), nullptr);
+	}
+	return found;
+}
+
+template <typename T>
+void ResultCache::store(const std::string& key, BasicPhylogeny<T>& phylo,
+		const std::vector<std::string>& labels) {
+	// The state is written into a temporary file of its own, which then
+	// replaces the entry, so that readers never find it partially written
+	std::string file = path(key);
+	std::string temporary = temporaryPath(file);
+	{
+		std::ofstream out(temporary.c_str(),
+				std::ios::binary | std::ios::trunc);
+		if (!out) {
+			throw std::runtime_error("cannot create " + temporary);
+		}
+		try {
+			phylo.writeState(out, labels);
+		} catch (const std::runtime_error&) {
+			out.close();
+			std::remove(temporary.c_str());
+			throw;
+		}
+		out.close();
+		if (!out) {
+			std::remove(temporary.c_str());
+			throw std::runtime_error("cannot write " + temporary);
+		}
+	}
+	replaceFile(temporary, file);
+	evict(file);
+	return;
+}
+
+std::string ResultCache::path(const std::string& key) const {
+	return this->directory + "/" + key + ENTRY_SUFFIX;
+}
+
+void ResultCache::evict(const std::string& kept) {
+	// Least recently used states are removed first, and the one just stored
+	// only if it exceeds the maximum size alone
+	DIR* dir = opendir(this->directory.c_str());
+	if (dir == nullptr) {
+		throw std::runtime_error("cannot list " + this->directory);
+	}
+	std::vector<CacheEntry> entries;
+	int64_t total = 0;
+	std::string suffix(ENTRY_SUFFIX);
+	while (struct dirent* item = readdir(dir)) {
+		std::string name = item->d_name;
+		std::string file = this->directory + "/" + name;
+		struct stat info;
+		if ((name.size() > suffix.size())
+				&& (name.compare(name.size() - suffix.size(), suffix.size(),
+						suffix) == 0)
+				&& (stat(file.c_str(), &info) == 0)) {
+			total += info.st_size;
+			if (file != kept) {
+				entries.push_back(CacheEntry(file, info.st_mtime,
+						info.st_size));
+			}
+		}
+	}
+	closedir(dir);
+	std::sort(entries.begin(), entries.end(), usedBefore);
+	for (std::size_t e = 0; (e < entries.size()) && (total > this->maxBytes);
+			e ++) {
+		if (std::remove(entries[e].path.c_str()) == 0) {
+			total -= entries[e].bytes;
+		}
+	}
+	if (total > this->maxBytes) {
+		std::remove(kept.c_str());
+	}
+	return;
+}
+
+// Storage types of the distances
+template bool ResultCache::load(const std::string& key,
+		BasicPhylogeny<double>& phylo,
+		const std::vector<std::string>& labels) const;
+template bool ResultCache::load(const std::string& key,
+		BasicPhylogeny<float>& phylo,
+		const std::vector<std::string>& labels) const;
+template bool ResultCache::load(const std::string& key,
+		BasicPhylogeny<int32_t>& phylo,
+		const std::vector<std::string>& labels) const;
+template void ResultCache::store(const std::string& key,
+		BasicPhylogeny<double>& phylo, const std::vector<std::string>& labels);
+template void ResultCache::store(const std::string& key,
+		BasicPhylogeny<float>& phylo, const std::vector<std::string>& labels);
+template void ResultCache::store(const std::string& key,
+		BasicPhylogeny<int32_t>& phylo, const std::vector<std::string>& labels);
@@ -0,0 +1,34 @@
+#ifndef RESULTCACHE_H_
+#define RESULTCACHE_H_
+
+#include <cstdint>  // int64_t, uint64_t
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+#include "Matrix.h"
+#include "Phylogeny.h"
+
+// Directory of finished reconstructions, stored as their final states and
+// named by a hash of their distances, labels and options. The least recently
+// used ones are removed once the directory exceeds its maximum size
+class ResultCache {
+public:
+    ResultCache(const std::string& directory, int64_t maxBytes);
+    static uint64_t hash(const Matrix& dist,
+    		const std::vector<std::string>& labels);
+    static std::string key(uint64_t hash, int precision, Storage storage,
+    		double scale, bool fallback, bool incremental, bool bounded);
+    template <typename T>
+    bool load(const std::string& key, BasicPhylogeny<T>& phylo,
+    		const std::vector<std::string>& labels) const;
+    template <typename T>
+    void store(const std::string& key, BasicPhylogeny<T>& phylo,
+    		const std::vector<std::string>& labels);
+private:
+    std::string directory;  // Directory of the cached states
+    int64_t maxBytes;  // Maximum size of the cached states
+    std::string path(const std::string& key) const;
+    void evict(const std::string& kept);
+};
+
+#endif /* RESULTCACHE_H_ */
@@ -0,0 +1,36 @@
+#include "TemporaryFile.h"
+
+#include <atomic>  // std::atomic
+#include <cstdint>  // uint64_t
+#include <cstdio>  // std::remove, std::rename, std::snprintf
+#include <functional>  // std::hash
+#include <stdexcept>  // std::runtime_error
+#include <string>  // std::string
+#include <thread>  // std::this_thread
+
+#include <unistd.h>  // getpid
+
+// Temporary files named by this process
+static std::atomic<uint64_t> nTemporaries(0);
+
+std::string temporaryPath(const std::string& file) {
+	char suffix[64];
+	std::snprintf(suffix, sizeof(suffix), ".%lx-%llx-%llx.tmp",
+			(unsigned long)getpid(),
+			(unsigned long long)std::hash<std::thread::id>()(
+					std::this_thread::get_id()),
+			(unsigned long long)nTemporaries++);
+	return file + suffix;
+}
+
+void replaceFile(const std::string& temporary, const std::string& file) {
+	// Existing files are not replaced by renames on every system
+	if (std::rename(temporary.c_str(), file.c_str()) != 0) {
+		std::remove(file.c_str());
+		if (std::rename(temporary.c_str(), file.c_str()) != 0) {
+			std::remove(temporary.c_str());
+			throw std::runtime_error("cannot replace " + file);
+		}
+	}
+	return;
+}
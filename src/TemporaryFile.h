@@ -0,0 +1,15 @@
+#ifndef TEMPORARYFILE_H_
+#define TEMPORARYFILE_H_
+
+#include <string>  // std::string
+
+// Path of a new temporary file next to file, unique among the processes,
+// threads and calls of every thread, so that concurrent writers of the same
+// file never write the same temporary one
+std::string temporaryPath(const std::string& file);
+
+// Replaces file with the complete temporary file, which is removed if it
+// cannot replace file
+void replaceFile(const std::string& temporary, const std::string& file);
+
+#endif /* TEMPORARYFILE_H_ */
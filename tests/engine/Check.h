@@ -0,0 +1,78 @@
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <cstdint>  // int32_t, int64_t, uint64_t
+#include <cstdlib>  // EXIT_FAILURE, EXIT_SUCCESS
+#include <iostream>  // std::cerr
+#include <stdexcept>  // std::runtime_error
+#include <string>  // std::string, std::to_string
+#include <vector>  // std::vector
+
+#include "DistanceGenerator.h"
+#include "Matrix.h"
+
+// Checks of a test of the engine, which reports every failed check and fails
+// if there is any. Every test is a program of its own, run by ctest
+static int nFailures = 0;
+
+inline void check(bool passed, const std::string& what) {
+	if (!passed) {
+		std::cerr << "FAILED: " << what << "\n";
+		nFailures ++;
+	}
+	return;
+}
+
+inline int testStatus() {
+	return (nFailures == 0)? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Distances of the kinds of the benchmarks, which are tied at low precisions
+inline std::vector<double> distances(const std::string& kind, int64_t n,
+		uint64_t seed) {
+	DistanceGenerator generator(seed);
+	std::vector<double> values;
+	if (kind == "euclidean") {
+		values = generator.euclidean(n, 2);
+	} else if (kind == "ultrametric") {
+		values = generator.ultrametric(n);
+	} else if (kind == "additive") {
+		values = generator.additive(n);
+	} else if (kind == "discrete") {
+		values = generator.discrete(n, 10);
+	} else {
+		throw std::runtime_error("unknown kind of distances: " + kind);
+	}
+	return values;
+}
+
+// Labels t1, ..., tn of the taxa
+inline std::vector<std::string> taxa(int64_t n) {
+	std::vector<std::string> labels;
+	for (int64_t i = 1; i <= n; i ++) {
+		labels.push_back("t" + std::to_string(i));
+	}
+	return labels;
+}
+
+// Scale of the storage of T at the precision, as chosen by the R package and
+// the command-line tool, or 0 if the distances do not fit
+template <typename T>
+double storageScale(const Matrix& dist, int precision);
+
+template <>
+inline double storageScale<double>(const Matrix&, int) {
+	return 1.0;
+}
+
+template <>
+inline double storageScale<float>(const Matrix& dist, int precision) {
+	return floatScale(dist, precision);
+}
+
+template <>
+inline double storageScale<int32_t>(const Matrix& dist, int precision) {
+	return fixedScale(dist, precision);
+}
+
+#endif /* CHECK_H_ */
@@ -0,0 +1,126 @@
+#include <cstdint>  // int64_t
+#include <cstdio>  // std::remove
+#include <fstream>  // std::ifstream
+#include <iterator>  // std::istreambuf_iterator
+#include <stdexcept>  // std::runtime_error
+#include <string>  // std::string, std::to_string
+#include <vector>  // std::vector
+
+#ifndef _WIN32
+#include <dirent.h>  // closedir, opendir, readdir
+#endif
+
+#include "Check.h"
+#include "DistanceFile.h"
+#include "Matrix.h"
+#include "Phylogeny.h"
+
+static const char* FILE_PATH = "test_append.mfnj";
+static const char* FULL_PATH = "test_append_full.mfnj";
+
+static std::string contents(const std::string& path) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in),
+			std::istreambuf_iterator<char>());
+}
+
+#ifndef _WIN32
+static int numTemporaries() {
+	// Temporary files left by the appends in the working directory
+	int nTemporaries = 0;
+	std::string prefix(FILE_PATH);
+	std::string suffix(".tmp");
+	DIR* dir = opendir(".");
+	while (struct dirent* item = readdir(dir)) {
+		std::string name = item->d_name;
+		if ((name.size() > prefix.size() + suffix.size())
+				&& (name.compare(0, prefix.size(), prefix) == 0)
+				&& (name.compare(name.size() - suffix.size(), suffix.size(),
+						suffix) == 0)) {
+			nTemporaries ++;
+		}
+	}
+	closedir(dir);
+	return nTemporaries;
+}
+
+static bool appendFails(const std::vector<double>& rows,
+		const std::vector<std::string>& labels) {
+	bool failed = false;
+	try {
+		DistanceFile::append(FILE_PATH, rows.data(), labels);
+	} catch (const std::runtime_error&) {
+		failed = true;
+	}
+	return failed;
+}
+
+static void checkAppend(const std::string& kind) {
+	// The first n taxa are written, and the other k appended, which gives the
+	// file written with all of them at once, and therefore the same tree
+	const int64_t n = 40;
+	const int64_t k = 7;
+	const int64_t m = n + k;
+	Matrix full(distances(kind, m, 3));
+	std::vector<std::string> labels = taxa(m);
+	std::vector<std::string> first(labels.begin(), labels.begin() + n);
+	std::vector<std::string> added(labels.begin() + n, labels.end());
+	std::vector<double> values;
+	for (int64_t j = 0; j < n; j ++) {
+		for (int64_t i = j + 1; i < n; i ++) {
+			values.push_back(full.value(i, j));
+		}
+	}
+	std::vector<double> rows(k * m);
+	for (int64_t a = 0; a < k; a ++) {
+		for (int64_t j = 0; j < m; j ++) {
+			rows[a * m + j] = full.value(n + a, j);
+		}
+	}
+	DistanceFile::write(FILE_PATH, values.data(), values.size(), first);
+	DistanceFile::write(FULL_PATH, full, labels);
+	DistanceFile::append(FILE_PATH, rows.data(), added);
+	check(contents(FILE_PATH) == contents(FULL_PATH),
+			kind + ": appended file");
+	check(numTemporaries() == 0, kind + ": temporary files");
+	{
+		DistanceFile file(FILE_PATH, false);
+		check(file.getLabels() == labels, kind + ": labels");
+		Phylogeny appended(Matrix(file.values(), file.numValues()), 3);
+		appended.reconstruct();
+		Phylogeny expected(full, 3);
+		expected.reconstruct();
+		check(appended.getNewick(labels) == expected.getNewick(labels),
+				kind + ": tree");
+	}
+	// Labels already in the file, or repeated in the new taxa, are rejected
+	// and leave the file untouched
+	std::string before = contents(FILE_PATH);
+	std::vector<std::string> known;
+	std::vector<std::string> repeated;
+	for (int64_t a = 0; a < k; a ++) {
+		known.push_back("x" + std::to_string(a));
+		repeated.push_back("y" + std::to_string(a % 3));
+	}
+	known.back() = labels.front();
+	std::vector<double> more(k * (m + k), 1.0);
+	check(appendFails(more, known), kind + ": label of the file");
+	check(appendFails(more, repeated), kind + ": repeated label");
+	check(contents(FILE_PATH) == before, kind + ": file after rejections");
+	check(numTemporaries() == 0, kind + ": temporary files of rejections");
+	std::remove(FILE_PATH);
+	std::remove(FULL_PATH);
+	return;
+}
+#endif
+
+int main() {
+	// Distance files are memory-mapped, which is not supported on Windows
+#ifndef _WIN32
+	const char* kinds[] = {"euclidean", "ultrametric", "additive", "discrete"};
+	for (int k = 0; k < 4; k ++) {
+		checkAppend(kinds[k]);
+	}
+#endif
+	return testStatus();
+}
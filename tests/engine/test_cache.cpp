@@ -0,0 +1,175 @@
+#include <cstdint>  // int32_t, int64_t, uint64_t
+#include <cstdio>  // std::remove
+#include <set>  // std::set
+#include <stdexcept>  // std::runtime_error
+#include <string>  // std::string
+#include <thread>  // std::thread
+#include <vector>  // std::vector
+
+#ifndef _WIN32
+#include <dirent.h>  // closedir, opendir, readdir
+#include <sys/stat.h>  // mkdir, stat
+#include <unistd.h>  // rmdir
+#endif
+
+#include "Check.h"
+#include "Matrix.h"
+#include "Phylogeny.h"
+#include "ResultCache.h"
+#include "TemporaryFile.h"
+
+static const char* CACHE_DIRECTORY = "test_cache_directory";
+
+#ifndef _WIN32
+static std::vector<std::string> cachedFiles() {
+	std::vector<std::string> files;
+	DIR* dir = opendir(CACHE_DIRECTORY);
+	if (dir == nullptr) {
+		throw std::runtime_error("cannot list " + std::string(CACHE_DIRECTORY));
+	}
+	while (struct dirent* item = readdir(dir)) {
+		std::string name = item->d_name;
+		if ((name != ".") && (name != "..")) {
+			files.push_back(name);
+		}
+	}
+	closedir(dir);
+	return files;
+}
+
+static void clearCache() {
+	std::vector<std::string> files = cachedFiles();
+	for (std::size_t f = 0; f < files.size(); f ++) {
+		std::remove((std::string(CACHE_DIRECTORY) + "/" + files[f]).c_str());
+	}
+	return;
+}
+
+static void checkKeys() {
+	// Every option that changes the rounding of the reconstruction, and the
+	// search, gives a key of its own, and the same options the same key
+	Matrix dist(distances("additive", 30, 4));
+	std::vector<std::string> labels = taxa(30);
+	uint64_t hash = ResultCache::hash(dist, labels);
+	check(ResultCache::hash(dist, labels) == hash, "hash of the same input");
+	std::vector<std::string> renamed(labels);
+	renamed.back() = "other";
+	check(ResultCache::hash(dist, renamed) != hash, "hash of other labels");
+	Matrix changed(dist);
+	changed.setValue(2, 1, changed.value(2, 1) + 1e-9);
+	check(ResultCache::hash(changed, labels) != hash,
+			"hash of other distances");
+	std::string key = ResultCache::key(hash, 3, FIXED_STORAGE, 1e6, false,
+			false, false);
+	check(ResultCache::key(hash, 3, FIXED_STORAGE, 1e6, false, false, false)
+			== key, "key of the same options");
+	std::set<std::string> keys;
+	keys.insert(key);
+	keys.insert(ResultCache::key(hash + 1, 3, FIXED_STORAGE, 1e6, false,
+			false, false));
+	keys.insert(ResultCache::key(hash, 4, FIXED_STORAGE, 1e6, false, false,
+			false));
+	keys.insert(ResultCache::key(hash, 3, FLOAT_STORAGE, 1e6, false, false,
+			false));
+	keys.insert(ResultCache::key(hash, 3, FIXED_STORAGE, 1e7, false, false,
+			false));
+	keys.insert(ResultCache::key(hash, 3, DOUBLE_STORAGE, 0.0, false, false,
+			false));
+	keys.insert(ResultCache::key(hash, 3, DOUBLE_STORAGE, 0.0, true, false,
+			false));
+	keys.insert(ResultCache::key(hash, 3, FIXED_STORAGE, 1e6, false, true,
+			false));
+	keys.insert(ResultCache::key(hash, 3, FIXED_STORAGE, 1e6, false, false,
+			true));
+	check(keys.size() == 9, "keys of different options");
+	return;
+}
+
+static void storeTree(ResultCache* cache, std::string key, Phylogeny* phylo,
+		std::vector<std::string>* labels, int* failed) {
+	try {
+		cache->store(key, *phylo, *labels);
+	} catch (const std::runtime_error&) {
+		*failed = 1;
+	}
+	return;
+}
+
+static void checkStore() {
+	// Stored trees are loaded back, unless their labels differ or they were
+	// evicted, and concurrent stores of the same key never fail
+	Matrix dist(distances("discrete", 60, 5));
+	std::vector<std::string> labels = taxa(60);
+	Phylogeny phylo(dist, 2);
+	phylo.reconstruct();
+	std::string key = ResultCache::key(ResultCache::hash(dist, labels), 2,
+			DOUBLE_STORAGE, 0.0, false, false, false);
+	ResultCache cache(CACHE_DIRECTORY, 1 << 30);
+	Phylogeny missed;
+	check(!cache.load(key, missed, labels), "load of a missing tree");
+	cache.store(key, phylo, labels);
+	Phylogeny loaded;
+	check(cache.load(key, loaded, labels), "load of a stored tree");
+	check(loaded.isFinished(), "loaded tree finished");
+	check(loaded.getNewick(labels) == phylo.getNewick(labels), "loaded tree");
+	std::vector<std::string> renamed(labels);
+	renamed.front() = "other";
+	Phylogeny collided;
+	check(!cache.load(key, collided, renamed), "load with other labels");
+	// Writing a state compacts it, so every thread stores a copy of its own
+	std::vector<Phylogeny> copies(8, phylo);
+	std::vector<int> failures(copies.size(), 0);
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < copies.size(); t ++) {
+		threads.push_back(std::thread(storeTree, &cache, key, &copies[t],
+				&labels, &failures[t]));
+	}
+	for (std::size_t t = 0; t < threads.size(); t ++) {
+		threads[t].join();
+	}
+	int nFailed = 0;
+	for (std::size_t t = 0; t < failures.size(); t ++) {
+		nFailed += failures[t];
+	}
+	check(nFailed == 0, "concurrent stores");
+	check(cachedFiles().size() == 1, "files after concurrent stores");
+	Phylogeny reloaded;
+	check(cache.load(key, reloaded, labels)
+			&& (reloaded.getNewick(labels) == phylo.getNewick(labels)),
+			"load after concurrent stores");
+	// A cache smaller than two trees keeps the last one stored, and none if
+	// it exceeds the maximum size alone
+	clearCache();
+	cache.store(key, phylo, labels);
+	std::string file = std::string(CACHE_DIRECTORY) + "/" + cachedFiles()[0];
+	struct stat info;
+	stat(file.c_str(), &info);
+	ResultCache small(CACHE_DIRECTORY, info.st_size * 3 / 2);
+	std::string other = ResultCache::key(ResultCache::hash(dist, labels), 3,
+			DOUBLE_STORAGE, 0.0, false, false, false);
+	small.store(other, phylo, labels);
+	check(!small.load(key, loaded, labels), "evicted tree");
+	check(small.load(other, loaded, labels), "tree stored last");
+	ResultCache tiny(CACHE_DIRECTORY, info.st_size / 2);
+	tiny.store(key, phylo, labels);
+	check(cachedFiles().empty(), "tree larger than the cache");
+	return;
+}
+#endif
+
+int main() {
+	// The cache directory is created beforehand, as mfnj() does, with the
+	// functions of POSIX systems
+#ifndef _WIN32
+	std::string path = temporaryPath("state");
+	check(temporaryPath("state") != path, "unique temporary paths");
+	check(path.compare(0, 6, "state.") == 0, "temporary path of the file");
+	checkKeys();
+	mkdir(CACHE_DIRECTORY, 0755);
+	clearCache();
+	checkStore();
+	clearCache();
+	rmdir(CACHE_DIRECTORY);
+#endif
+	return testStatus();
+}
@@ -0,0 +1,88 @@
+#include <cstdint>  // int32_t, int64_t
+#include <sstream>  // std::stringstream
+#include <string>  // std::string, std::to_string
+#include <vector>  // std::vector
+
+#include "Check.h"
+#include "Matrix.h"
+#include "Phylogeny.h"
+#include "Profile.h"
+
+// Progress that stops the reconstruction after a number of rounds, as the
+// signals of the command-line tool do
+class StopAfter : public Progress {
+public:
+	StopAfter(int64_t rounds);
+	bool update(int64_t round, int64_t nOTUs);
+private:
+	int64_t rounds;  // Rounds to reconstruct
+};
+
+StopAfter::StopAfter(int64_t rounds) {
+	this->rounds = rounds;
+}
+
+bool StopAfter::update(int64_t round, int64_t) {
+	return round < this->rounds;
+}
+
+template <typename T>
+static void checkResume(const std::string& kind, bool incremental,
+		bool bounded) {
+	// Reconstructions stopped after some rounds, written and read back from
+	// their states, and then resumed give the tree of an uninterrupted one
+	const int64_t n = 80;
+	const int digits = 3;
+	Matrix dist(distances(kind, n, 1));
+	double scale = storageScale<T>(dist, digits);
+	if (scale == 0.0) {
+		return;  // the storage falls back to double
+	}
+	std::vector<std::string> labels = taxa(n);
+	BasicPhylogeny<T> full(BasicMatrix<T>(dist, scale), digits);
+	full.setIncrementalSums(incremental);
+	full.setBoundedSearch(bounded);
+	full.reconstruct();
+	std::string expected = full.getNewick(labels);
+	const int64_t stops[] = {1, 5, 20};
+	for (int s = 0; s < 3; s ++) {
+		std::string name = kind + " storage " + std::to_string(full.getStorage())
+				+ (incremental? " incremental" : "") + (bounded? " bounded" : "")
+				+ " stopped after " + std::to_string(stops[s]) + " rounds";
+		BasicPhylogeny<T> part(BasicMatrix<T>(dist, scale), digits);
+		part.setIncrementalSums(incremental);
+		part.setBoundedSearch(bounded);
+		StopAfter stop(stops[s]);
+		part.setProgress(&stop);
+		part.reconstruct();
+		part.setProgress(nullptr);
+		std::stringstream state;
+		part.writeState(state, labels);
+		check(stateStorage(state) == full.getStorage(), name + ": storage");
+		// Storage and search options are those of the state
+		BasicPhylogeny<T> resumed;
+		std::vector<std::string> resumedLabels;
+		resumed.readState(state, resumedLabels);
+		check(resumedLabels == labels, name + ": labels");
+		resumed.reconstruct();
+		check(resumed.isFinished(), name + ": finished");
+		check(resumed.getNewick(labels) == expected, name + ": tree");
+		check(resumed.numPolytomies() == full.numPolytomies(),
+				name + ": polytomies");
+	}
+	return;
+}
+
+int main() {
+	const char* kinds[] = {"euclidean", "ultrametric", "additive", "discrete"};
+	for (int k = 0; k < 4; k ++) {
+		for (int options = 0; options < 4; options ++) {
+			bool incremental = (options & 1) != 0;
+			bool bounded = (options & 2) != 0;
+			checkResume<double>(kinds[k], incremental, bounded);
+			checkResume<float>(kinds[k], incremental, bounded);
+			checkResume<int32_t>(kinds[k], incremental, bounded);
+		}
+	}
+	return testStatus();
+}
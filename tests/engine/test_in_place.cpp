@@ -0,0 +1,68 @@
+#include <cstdio>  // std::remove
+#include <stdexcept>  // std::runtime_error
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+#include "Check.h"
+#include "DistanceFile.h"
+#include "Matrix.h"
+#include "Phylogeny.h"
+
+static const char* FILE_PATH = "test_in_place.mfnj";
+
+#ifndef _WIN32
+static bool openFails(bool inPlace) {
+	bool failed = false;
+	try {
+		DistanceFile file(FILE_PATH, inPlace);
+	} catch (const std::runtime_error&) {
+		failed = true;
+	}
+	return failed;
+}
+
+static void checkInPlace() {
+	// Files read privately stay valid, whereas those mapped in place are
+	// marked before their distances change, and rejected afterwards even if
+	// the reconstruction did not change them
+	Matrix dist(distances("euclidean", 30, 6));
+	std::vector<std::string> labels = taxa(30);
+	DistanceFile::write(FILE_PATH, dist, labels);
+	{
+		DistanceFile file(FILE_PATH, false);
+		Phylogeny phylo(Matrix(file.values(), file.numValues(), true), 4);
+		phylo.reconstruct();
+	}
+	check(!openFails(false), "file read privately");
+	{
+		DistanceFile file(FILE_PATH, true);
+		check(openFails(false), "file opened while mapped in place");
+		Phylogeny phylo(Matrix(file.values(), file.numValues(), true), 4);
+		phylo.reconstruct();
+	}
+	check(openFails(false), "file read after an update in place");
+	check(openFails(true), "file updated after an update in place");
+	std::vector<double> rows(31, 1.0);
+	bool appended = true;
+	try {
+		DistanceFile::append(FILE_PATH, rows.data(),
+				std::vector<std::string>(1, "new"));
+	} catch (const std::runtime_error&) {
+		appended = false;
+	}
+	check(!appended, "append after an update in place");
+	// Files written again are valid
+	DistanceFile::write(FILE_PATH, dist, labels);
+	check(!openFails(true), "file written again");
+	std::remove(FILE_PATH);
+	return;
+}
+#endif
+
+int main() {
+	// Distance files are memory-mapped, which is not supported on Windows
+#ifndef _WIN32
+	checkInPlace();
+#endif
+	return testStatus();
+}
@@ -0,0 +1,60 @@
+#include <cstddef>  // std::size_t
+#include <cstdint>  // int32_t, int64_t
+#include <string>  // std::string, std::to_string
+#include <vector>  // std::vector
+
+#include "Check.h"
+#include "Matrix.h"
+#include "Phylogeny.h"
+
+template <typename T>
+static void checkSweep(const std::string& kind, bool incremental,
+		bool bounded) {
+	// Every tree of a sweep is the tree reconstructed alone at its precision,
+	// with precisions unsorted and repeated. A storage shares a sweep only at
+	// the precisions of the same scale, which fixed-point keeps for all of
+	// them
+	const int64_t n = 80;
+	const std::vector<int> precisions = {3, 1, 6, 0, 3, 2};
+	Matrix dist(distances(kind, n, 2));
+	double scale = storageScale<T>(dist, 6);
+	if (scale == 0.0) {
+		return;  // the storage falls back to double
+	}
+	std::vector<std::string> labels = taxa(n);
+	BasicPhylogeny<T> phylo(BasicMatrix<T>(dist, scale), precisions.front());
+	phylo.setIncrementalSums(incremental);
+	phylo.setBoundedSearch(bounded);
+	std::vector< BasicPhylogeny<T> > trees = phylo.sweep(precisions);
+	check(trees.size() == precisions.size(), kind + ": number of trees");
+	for (std::size_t p = 0; p < trees.size(); p ++) {
+		std::string name = kind + " storage "
+				+ std::to_string(phylo.getStorage())
+				+ (incremental? " incremental" : "") + (bounded? " bounded" : "")
+				+ " at " + std::to_string(precisions[p]) + " digits";
+		BasicPhylogeny<T> alone(BasicMatrix<T>(dist, scale), precisions[p]);
+		alone.setIncrementalSums(incremental);
+		alone.setBoundedSearch(bounded);
+		alone.reconstruct();
+		check(trees[p].isFinished(), name + ": finished");
+		check(trees[p].getPrecision() == precisions[p], name + ": precision");
+		check(trees[p].getNewick(labels) == alone.getNewick(labels),
+				name + ": tree");
+		check(trees[p].numPolytomies() == alone.numPolytomies(),
+				name + ": polytomies");
+	}
+	return;
+}
+
+int main() {
+	const char* kinds[] = {"euclidean", "ultrametric", "additive", "discrete"};
+	for (int k = 0; k < 4; k ++) {
+		for (int options = 0; options < 4; options ++) {
+			bool incremental = (options & 1) != 0;
+			bool bounded = (options & 2) != 0;
+			checkSweep<double>(kinds[k], incremental, bounded);
+			checkSweep<int32_t>(kinds[k], incremental, bounded);
+		}
+	}
+	return testStatus();
+}